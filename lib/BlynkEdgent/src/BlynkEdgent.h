@@ -24,12 +24,38 @@
 #include <BlynkSysUtils.h>
 #include <Blynk/BlynkConsole.h>
 #include <ConfigStore.h>
+#include <JsonWriter.h>
+#include <EdgentTelemetry.h>
+#include <EdgentOutbox.h>
+#include <EdgentShadow.h>
+#include <EdgentSampler.h>
+#include <EdgentTime.h>
+#include <EdgentMemory.h>
+#include <EdgentTrace.h>
+#include <EdgentProfiler.h>
+#include <EdgentLoop.h>
+#include <EdgentUsage.h>
+#include <EdgentLink.h>
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+#  include <TelemetryJournal.h>
+static_assert(TELEMETRY_VALUE_SIZE <= JOURNAL_VALUE_SIZE, "Journal value size is too small");
+#endif
+
+#if defined(CONFIG_EDGE_RULES)
+#  include <EdgeRules.h>
+#endif
+
+#if defined(CONFIG_COMPRESSION)
+#  include <LzStream.h>
+#endif
 
 class Edgent {
 
 public:
 
   typedef void (*callback0_t)(void);
+  typedef void (*ruleWrite_t)(uint8_t pin, float value);
+  typedef void (*serverTime_t)(uint64_t utc);
 
   enum State {
     MODE_IDLE,
@@ -42,8 +68,19 @@ public:
 
     MODE_MAX_VALUE
   };
+  static_assert(MODE_MAX_VALUE <= LoopMonitor::MAX_STATES, "LoopMonitor needs more states");
+
+  enum ParticleCloud {
+    PARTICLE_CLOUD_NEVER,
+    PARTICLE_CLOUD_ON_DEMAND,
+    PARTICLE_CLOUD_ALWAYS
+  };
 
   static String getStateName(State m) {
+    return getStateStr(m);
+  }
+
+  static const char* getStateStr(State m) {
     if (m > MODE_MAX_VALUE) return "";
     static const char* stateStr[MODE_MAX_VALUE+1] = {
       "IDLE",
@@ -71,6 +108,26 @@ public:
     }
   }
 
+  // Run BLE provisioning alongside the cloud connection.
+  // The cloud session is dropped only when a new config is received.
+  void setConcurrentConfig(bool enable) {
+    _configConcurrent = enable;
+  }
+
+  // Main loop passes longer than this are counted as overruns (see "sys loop").
+  // Call after begin(), which sets the defaults
+  void setLoopBudget(State state, uint32_t ms) {
+    _loop.setBudget(state, ms);
+  }
+
+  // Particle Cloud is not needed for Blynk, but is used for OTA updates.
+  // In ON_DEMAND mode, it is connected every `interval` seconds (if set)
+  // or when requested using connectParticleCloud()
+  void setParticleCloud(ParticleCloud policy, uint32_t interval = 0) {
+    _particlePolicy = policy;
+    _particleInterval = interval;
+  }
+
   bool begin()
   {
     if (!String(BLYNK_TEMPLATE_ID).startsWith("TMPL")) {
@@ -78,14 +135,64 @@ public:
       return false;
     }
 
+    _memory.begin();
     systemInit(BLYNK_DEVICE_PREFIX, BLYNK_TEMPLATE_NAME);
 
     NetMgr.begin();
 
-    _store.begin();
+    {
+      EDGENT_MEM_SCOPE(MEM_CONFIG);
+      _store.begin();
+    }
+    loadStats();
+    _time.begin(_store.getTimeDrift());
+    if (Time.isValid()) {
+      // RTC keeps running across resets
+      _time.sync(uint64_t(Time.now()) * 1000, TimeService::SOURCE_RTC);
+    }
+    loadHostAddr();
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+    if (!_journal.begin(TELEMETRY_JOURNAL_DIR,
+                        TELEMETRY_JOURNAL_SEGMENT,
+                        TELEMETRY_JOURNAL_SEGMENTS,
+                        TELEMETRY_JOURNAL_SYNC))
+    {
+      BLYNK_LOG1(F("Telemetry journal failed"));
+    }
+    _journalBootSeq = _journal.nextSeq();
+#endif
+#if defined(CONFIG_EDGE_RULES)
+    _rules.onWrite(ruleWriteCb);
+    _rules.onEvent(ruleEventCb);
+    loadRules();
+#endif
     printBanner();
     initConsoleCommands();
 
+    // Connecting may include blocking calls
+    _loop.setBudget(MODE_CONNECTING_NET,   LOOP_BUDGET_CONNECTING);
+    _loop.setBudget(MODE_CONNECTING_CLOUD, LOOP_BUDGET_CONNECTING);
+#if defined(CONFIG_HW_WATCHDOG) && defined(PARTICLE)
+    Watchdog.init(WatchdogConfiguration().timeout(HW_WATCHDOG_TIMEOUT));
+    Watchdog.start();
+#endif
+
+    _timer.setInterval(1000L, particleCloudTickCb);
+    _timer.setInterval(TELEMETRY_FLUSH_INTERVAL, telemetryFlushCb);
+    _timer.setInterval(SAMPLER_TICK_INTERVAL, samplerTickCb);
+    _timer.setInterval(1000L, timeTickCb);
+    _timer.setInterval(MEM_SAMPLE_INTERVAL, memorySampleCb);
+    _timer.setInterval(1000L, usageTickCb);
+#if STATS_CHECKPOINT_INTERVAL
+    _timer.setInterval(STATS_CHECKPOINT_INTERVAL * 1000L, statsCheckpointCb);
+#endif
+#if defined(DIAG_SNAPSHOT_PIN)
+    _timer.setInterval(DIAG_SNAPSHOT_INTERVAL * 1000L, diagSnapshotCb);
+#endif
+#if defined(BLYNK_SERVER_CANDIDATES)
+    _timer.setInterval(1000L, serverProbeTickCb);
+#endif
+
     if (isConfigured()) {
       setState(MODE_CONNECTING_NET);
     } else if (_configSkipLimit &&
@@ -101,11 +208,440 @@ public:
 
   void initConsole(Stream& stream);
 
+  // Same as Blynk.virtualWrite, but the value is filtered, queued while
+  // offline and combined with other writes within the coalescing window
+  template <typename T>
+  void virtualWrite(int pin, const T& value) {
+    char buff[TELEMETRY_VALUE_SIZE];
+    BlynkParam param(buff, 0, sizeof(buff));
+    param.add(value);
+    if (_filters.find(pin) || _shadow.find(pin) || usesRules(pin) ||
+        !isTelemetryDirect())
+    {
+      if (!param.getLength()) {   // Value too long
+        systemStats.telemetry.dropped++;
+        return;
+      }
+      writeTelemetry(pin, buff);
+    } else {
+      Blynk.virtualWrite(pin, value);
+      _usage.addMessage(DataUsage::USAGE_TELEMETRY,
+                        writeSize(pin, param.getLength() ? param.getLength() - 1 : sizeof(buff)));
+    }
+  }
+
+  // Skip values that changed by no more than deadband (absolute units),
+  // or were written sooner than minInterval after the previous one.
+  // The last value is re-sent after maxSilence without a send
+  bool setPinFilter(int pin, float deadband, uint32_t minInterval = 0,
+                    uint32_t maxSilence = 0)
+  {
+    return _filters.add(pin, deadband, false, minInterval, maxSilence);
+  }
+
+  // Same as setPinFilter, with deadband in percent of the last sent value
+  bool setPinFilterPercent(int pin, float deadband, uint32_t minInterval = 0,
+                           uint32_t maxSilence = 0)
+  {
+    return _filters.add(pin, deadband, true, minInterval, maxSilence);
+  }
+
+  void clearPinFilter(int pin) {
+    _filters.remove(pin);
+  }
+
+  // Keep the pin state locally: unchanged values are not re-sent,
+  // values changed while offline are sent once on reconnect
+  bool addShadowPin(int pin) {
+    return _shadow.add(pin) != NULL;
+  }
+
+  // Returns false if the incoming value matches the local state (see BLYNK_WRITE_SHADOW)
+  bool shadowReceive(int pin, const BlynkParam& param) {
+    inboundReceived(pin, param);
+    PinShadow::Entry* e = _shadow.add(pin);
+    if (e && !_shadow.receive(*e, param)) {
+      systemStats.shadow.suppressed++;
+      return false;
+    }
+    updateRules(pin, param.asStr());
+    return true;
+  }
+
+#if defined(CONFIG_EDGE_RULES)
+  // Compiles and stores local rules, one per line (see EdgeRules.h)
+  bool setRules(const char* text) {
+    if (!_rules.compile(text)) {
+      BLYNK_LOG2(F("Rules error: "), _rules.getError());
+      return false;
+    }
+    saveRules();
+    return true;
+  }
+
+  // Adds rules after the stored ones, which are kept as compiled
+  bool addRules(const char* text) {
+    if (!_rules.append(text)) {
+      BLYNK_LOG2(F("Rules error: "), _rules.getError());
+      return false;
+    }
+    saveRules();
+    return true;
+  }
+
+  void clearRules() {
+    _rules.clear();
+    saveRules();
+  }
+
+  // Called before the rule action value is sent to the cloud
+  void onRuleWrite(ruleWrite_t f) {
+    _onRuleWrite = f;
+  }
+#endif
+
+  // Same as Blynk.virtualWrite, sent ahead of telemetry (i.e. to confirm a command)
+  template <typename... Args>
+  void controlWrite(int pin, Args... values) {
+    char buff[OUTBOX_MSG_SIZE];
+    BlynkParam cmd(buff, 0, sizeof(buff));
+    cmd.add("vw");
+    cmd.add(pin);
+    cmd.add_multi(values...);
+    sendMessage(Outbox::PRIO_CONTROL, BLYNK_CMD_HARDWARE, cmd);
+  }
+
+  template <typename... Args>
+  void sendInternal(Args... params) {
+    char buff[OUTBOX_MSG_SIZE];
+    BlynkParam cmd(buff, 0, sizeof(buff));
+    cmd.add_multi(params...);
+    sendMessage(Outbox::PRIO_META, BLYNK_CMD_INTERNAL, cmd);
+  }
+
+  void logEvent(const char* event_name, const String& description = "") {
+    char buff[OUTBOX_MSG_SIZE];
+    BlynkParam cmd(buff, 0, sizeof(buff));
+    cmd.add(event_name);
+    if (description.length()) {
+      cmd.add(description);
+    }
+    sendMessage(Outbox::PRIO_EVENT, BLYNK_CMD_EVENT_LOG, cmd);
+  }
+
+  // Sends a large payload (i.e. a diagnostics dump or a batch) as binary.
+  // With CONFIG_COMPRESSION, and once the receiver has reported the "lz"
+  // capability (see setPeerCapabilities), it is LZ-compressed if that makes
+  // it smaller, and prefixed with "\x1F" "LZ" so the receiver can tell.
+  // Not deferred: returns false if the device is offline
+  bool virtualWriteCompressed(int pin, const void* data, size_t len) {
+    if (_state != MODE_RUNNING || !Blynk.connected()) {
+      return false;
+    }
+#if defined(CONFIG_COMPRESSION)
+    if (_peerLz && len >= COMPRESSION_MIN_SIZE) {
+      memcpy(_lzBuff, "\x1F" "LZ", 3);
+      const size_t clen = lzCompress(_lzEncoder, data, len, _lzBuff + 3,
+                                     BlynkMin(len, sizeof(_lzBuff)) - 3);
+      if (clen) {
+        systemStats.compression.messages++;
+        systemStats.compression.bytes_in += len;
+        systemStats.compression.bytes_out += clen + 3;
+        Blynk.virtualWriteBinary(pin, _lzBuff, clen + 3);
+        _usage.addMessage(DataUsage::USAGE_TELEMETRY, writeSize(pin, clen + 3));
+        return true;
+      }
+    }
+#endif
+    Blynk.virtualWriteBinary(pin, data, len);
+    _usage.addMessage(DataUsage::USAGE_TELEMETRY, writeSize(pin, len));
+    return true;
+  }
+
+  // Comma-separated, reported in devinfo
+  static const char* getCapabilities() {
+#if defined(CONFIG_COMPRESSION)
+    return "lz";
+#else
+    return "";
+#endif
+  }
+
+  // Comma-separated capabilities of the receiver of the uplink payloads.
+  // Compression is used only after the receiver reports "lz"
+  // (i.e. by writing it to COMPRESSION_PEER_PIN)
+  void setPeerCapabilities(const char* caps) {
+#if defined(CONFIG_COMPRESSION)
+    _peerLz = false;
+    for (const char* p = caps; p && *p; ) {
+      const char* end = strchr(p, ',');
+      const size_t n = end ? size_t(end - p) : strlen(p);
+      if (n == 2 && 0 == strncmp(p, "lz", 2)) {
+        _peerLz = true;
+      }
+      p = end ? end + 1 : NULL;
+    }
+#else
+    (void)caps;
+#endif
+  }
+
+  // Samples read() every sampleMs, the aggregates are sent every uploadMs
+  int addSampler(Sampler::read_t read, uint32_t sampleMs, uint32_t uploadMs) {
+    return _sampler.add(read, sampleMs, uploadMs);
+  }
+
+  bool setSamplerOutput(int channel, Sampler::Aggregate agg, int pin) {
+    return _sampler.setOutput(channel, agg, pin);
+  }
+
+  void setMessageRate(uint32_t rate, uint32_t burst) {
+    _outbox.setRate(rate, burst);
+  }
+
+  void setTelemetryPolicy(TelemetryQueue::Policy policy) {
+    _telemetry.setPolicy(policy);
+  }
+
+  void setWriteCoalescing(uint32_t windowMs) {
+    _coalesceWindow = windowMs;
+  }
+
+  // Stretched by the data usage governor
+  uint32_t getCoalesceWindow() const {
+    const uint32_t scale = _usage.getScale();
+    if (scale == 1) {
+      return _coalesceWindow;
+    }
+    return BlynkMax<uint32_t>(_coalesceWindow, USAGE_COALESCE_WINDOW) * scale;
+  }
+
+  // Budgets of the metered (cellular) interface, in bytes, 0 for no limit
+  void setDataBudget(uint32_t daily, uint32_t monthly) {
+    _usage.setBudget(daily, monthly);
+    applyUsageLevel();
+  }
+
+  const DataUsage& getDataUsage() const {
+    return _usage;
+  }
+
+  // Remote terminal output, counted and turned off by the governor
+  Stream& meterTerminal(Stream& stream) {
+    _terminalMeter.setStream(stream);
+    return _terminalMeter;
+  }
+
+private:
+
+  bool isTelemetryDirect() {
+    return _state == MODE_RUNNING && !getCoalesceWindow() && !hasQueuedTelemetry() &&
+           _outbox.acquire(Outbox::PRIO_TELEMETRY);
+  }
+
+  // Sends right away if within the budget, otherwise defers
+  void sendMessage(Outbox::Priority prio, uint8_t cmd, const BlynkParam& data) {
+    if (!data.getLength()) {   // Message too long
+      BLYNK_LOG1(F("Outgoing message too long"));
+      return;
+    }
+    // Payload excludes the trailing zero
+    if (_state == MODE_RUNNING && Blynk.connected() && _outbox.acquire(prio)) {
+      sendCmd(cmd, data.getBuffer(), data.getLength() - 1);
+    } else {
+      _outbox.push(prio, cmd, data.getBuffer(), data.getLength() - 1);
+    }
+  }
+
+  void sendCmd(uint8_t cmd, const void* data, size_t len) {
+    Blynk.sendCmd(cmd, 0, data, len);
+    _usage.addMessage((cmd == BLYNK_CMD_HARDWARE)  ? DataUsage::USAGE_TELEMETRY :
+                      (cmd == BLYNK_CMD_EVENT_LOG) ? DataUsage::USAGE_EVENTS :
+                                                     DataUsage::USAGE_PROTOCOL, len);
+  }
+
+  // Payload of a virtual pin write: "vw", pin and the value
+  static size_t writeSize(uint8_t pin, size_t valueLen) {
+    return 3 + (pin < 10 ? 1 : pin < 100 ? 2 : 3) + 1 + valueLen;
+  }
+
+  void sendValue(uint8_t pin, const char* value) {
+    char buff[TELEMETRY_VALUE_SIZE + 8];
+    BlynkParam cmd(buff, 0, sizeof(buff));
+    cmd.add("vw");
+    cmd.add(pin);
+    cmd.add(value);
+    sendMessage(Outbox::PRIO_TELEMETRY, BLYNK_CMD_HARDWARE, cmd);
+  }
+
+  bool usesRules(uint8_t pin) {
+#if defined(CONFIG_EDGE_RULES)
+    return _rules.uses(pin);
+#else
+    return false;
+#endif
+  }
+
+  void updateRules(uint8_t pin, const char* value) {
+#if defined(CONFIG_EDGE_RULES)
+    if (!_rules.uses(pin)) return;
+    char* end;
+    const float val = strtof(value, &end);
+    if (end != value && !*end) {
+      _rules.update(pin, val);
+    }
+#endif
+  }
+
+#if defined(CONFIG_EDGE_RULES)
+  static void ruleWriteCb(uint8_t pin, float value);
+  static void ruleEventCb(const char* event);
+
+  // Code is stored as a hex string
+  void loadRules() {
+    const String& hex = _store.getRules();
+    uint8_t code[EDGE_RULES_MAX_CODE];
+    const size_t len = hex.length() / 2;
+    if (!len || len > sizeof(code)) return;
+    for (size_t i = 0; i < len; i++) {
+      code[i] = strtoul(hex.substring(i * 2, i * 2 + 2).c_str(), NULL, 16);
+    }
+    if (!_rules.load(code, len)) {
+      BLYNK_LOG1(F("Stored rules are invalid"));
+    }
+  }
+
+  void saveRules() {
+    String hex;
+    hex.reserve(_rules.codeSize() * 2);
+    for (size_t i = 0; i < _rules.codeSize(); i++) {
+      char buf[3];
+      snprintf(buf, sizeof(buf), "%02x", _rules.code()[i]);
+      hex += buf;
+    }
+    _store.storeRules(hex);
+  }
+#endif
+
+  // Values written by the app (filter is set) also update the rules
+  void writeTelemetry(uint8_t pin, const char* value, bool filter = true) {
+    if (filter) {
+      updateRules(pin, value);
+    }
+
+    PinShadow::Entry* sh = _shadow.find(pin);
+    if (sh) {
+      const bool online = (_state == MODE_RUNNING);
+      if (_shadow.write(*sh, value, online)) {
+        sendValue(pin, value);
+      } else if (online) {
+        systemStats.shadow.skipped++;
+      }
+      return;
+    }
+
+    PinFilters::Filter* f = filter ? _filters.find(pin) : NULL;
+    if (f && _filters.check(*f, value, millis()) != PinFilters::SEND) {
+      systemStats.telemetry.filtered++;
+      return;
+    }
+
+    if (_state == MODE_RUNNING && hasQueuedTelemetry()) {
+      // Drain the backlog first, the value may still go out live
+      sendQueuedTelemetry();
+    }
+
+    if (_state == MODE_CONNECTING_NET || _state == MODE_CONNECTING_CLOUD ||
+        (_state == MODE_RUNNING && hasQueuedTelemetry(pin)))
+    {
+      queueTelemetry(pin, value);
+    } else if (_state == MODE_RUNNING && getCoalesceWindow()) {
+      combineTelemetry(pin, value);
+    } else {
+      sendValue(pin, value);
+    }
+  }
+
+  void queueTelemetry(uint8_t pin, const char* value, uint64_t ts = systemUptime()) {
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+    if (_telemetry.isFull()) {
+      // Move the oldest record to flash
+      const TelemetryRecord& rec = _telemetry.front();
+      uint64_t recTs = rec.ts;
+      const uint8_t flags = _time.toUtc(rec.ts, recTs) ? TelemetryJournal::FLAG_UTC : 0;
+      if (_journal.append(rec.pin, recTs, flags, rec.value)) {
+        _telemetry.pop();
+      }
+    }
+#endif
+    if (_telemetry.isFull()) {
+      systemStats.telemetry.dropped++;
+    }
+    if (_telemetry.push(pin, ts, value)) {
+      systemStats.telemetry.queued++;
+    }
+  }
+
+  void combineTelemetry(uint8_t pin, const char* value) {
+    if (_combiner.isEmpty()) {
+      _combinerStart = millis();
+    } else if (_combiner.isFull() && !_combiner.contains(pin)) {
+      // Flushed only when a new slot is needed
+      flushCombiner();
+      _combinerStart = millis();
+    }
+    const int replaced = _combiner.put(pin, value);
+    if (replaced >= 0) {
+      // Header, "vw", pin and the value that was not sent
+      systemStats.telemetry.coalesced++;
+      systemStats.telemetry.coalesced_bytes += DataUsage::HEADER_SIZE + writeSize(pin, replaced);
+    }
+  }
+
+  void flushCombiner() {
+    if (_state == MODE_RUNNING) {
+      _combiner.flush([this](uint8_t pin, const char* value) {
+        sendValue(pin, value);
+      });
+    } else {
+      _combiner.flush([this](uint8_t pin, const char* value) {
+        queueTelemetry(pin, value);
+      });
+    }
+  }
+
+public:
+
   void run() {
+    EDGENT_TRACE_SCOPE("Edgent::run");
+    const State state = _state;
+    if (state != _crashState) {
+      _crashState = state;
+      CrashRecord::setName(systemCrash.context.state, getStateStr(state));
+    }
+    _loop.begin();
+
     _timer.run();
-    _console.run();
+    _loop.mark(LoopMonitor::SEG_TIMER);
+    {
+      EDGENT_MEM_SCOPE(MEM_CONSOLE);
+      _console.run();
+    }
+    _loop.mark(LoopMonitor::SEG_CONSOLE);
+    {
+      EDGENT_MEM_SCOPE(MEM_NETMGR);
+      EDGENT_TRACE_SCOPE("NetMgr.run");
+      NetMgr.run();
+    }
+    _loop.mark(LoopMonitor::SEG_NETMGR);
 
-    NetMgr.run();
+    if (_injectConcurrent) {
+      runConcurrentConfig();
+    } else if (_injectVerifying) {
+      EDGENT_MEM_SCOPE(MEM_INJECT);
+      _inject.run();
+    }
+    _loop.mark(LoopMonitor::SEG_INJECT);
 
     switch (_state) {
     case MODE_IDLE:             stateIdle();              break;
@@ -116,6 +652,30 @@ public:
     case MODE_RESET_CONFIG:     stateResetConfig();       break;
     default:                    stateError();             break;
     }
+
+    const LoopMonitor::Result result = _loop.end(state);
+#if defined(CONFIG_TRACE)
+    const char* trace[CRASH_TRACE_EVENTS];
+    EdgentTrace::last(trace, CRASH_TRACE_EVENTS);
+    for (unsigned i = 0; i < CRASH_TRACE_EVENTS; i++) {
+      CrashRecord::setName(systemCrash.context.trace[i], trace[i]);
+    }
+#endif
+    if (result == LoopMonitor::STALL) {
+      const LoopMonitor::Overrun& o = _loop.getLastOverrun();
+      BLYNK_LOG("Loop stall: %lu ms in %s, %s took %lu ms",
+                o.duration, getStateName(state).c_str(),
+                LoopMonitor::getSegmentName(o.segment), o.segmentTime);
+      systemStats.loop.stalls++;
+      systemStats.loop.max_stall = BlynkMax(systemStats.loop.max_stall, o.duration);
+      retainedChanged();
+    }
+    retainedSync();
+#if defined(CONFIG_HW_WATCHDOG) && defined(PARTICLE)
+    if (result == LoopMonitor::WITHIN_BUDGET) {
+      Watchdog.refresh();
+    }
+#endif
   }
 
 private:
@@ -127,19 +687,17 @@ private:
    */
 
   void stateConfig() {
+    EDGENT_TRACE_SCOPE("Edgent::stateConfig");
     if (isEnteringState()) {
-      _inject._config.host = BLYNK_DEFAULT_SERVER;
-
-      _inject.setProvisionCallback(provisionCb);
-      _inject.begin(systemGetDeviceName(),
-                    BLYNK_DEVICE_PREFIX,
-                    BLYNK_TEMPLATE_ID,
-                    BLYNK_FIRMWARE_TYPE,
-                    BLYNK_FIRMWARE_VERSION);
+      _injectConcurrent = false;  // Owned by this state now
+      beginInject();
 
       setStateEntered();
     }
-    _inject.run();
+    {
+      EDGENT_MEM_SCOPE(MEM_INJECT);
+      _inject.run();
+    }
     if (millis() - _stateChangeTime > _configTimeoutMs) {
       if (_inject.isUserConfiguring()) {
         _stateChangeTime = millis(); // restart timer
@@ -154,6 +712,7 @@ private:
   }
 
   void stateIdle() {
+    EDGENT_TRACE_SCOPE("Edgent::stateIdle");
     if (isEnteringState()) {
       if (_prevState == MODE_WAIT_CONFIG) {
         _inject.end();
@@ -165,21 +724,33 @@ private:
   }
 
   void stateConnectingNet() {
+    EDGENT_TRACE_SCOPE("Edgent::stateConnectingNet");
     if (isEnteringState()) {
-      if (_prevState == MODE_WAIT_CONFIG) {
-        _inject.end();
+      if (_injectVerifying) {
+        _inject.reportProgress("associating");
+        _injectLinkUp = false;
+      } else if (_prevState == MODE_WAIT_CONFIG) {
+        endInject();
       }
       NetMgr.allOn();
       setStateEntered();
     }
 
+    if (_injectVerifying && !_injectLinkUp && NetMgr.isAnyLinkUp()) {
+      _inject.reportProgress("dhcp");
+      _injectLinkUp = true;
+    }
+
     if (NetMgr.isAnyConnected()) {
       _retriesNet = WIFI_CLOUD_MAX_RETRIES;
+      systemStats.latency.time_to_net.add(millis() - _stateEnterTime);
+      resolveHostAddr();
       setState(MODE_CONNECTING_CLOUD);
     } else if (millis() - _stateChangeTime > WIFI_NET_CONNECT_TIMEOUT) {
       BLYNK_LOG1(F("Network connection timeout"));
       if (--_retriesNet <= 0) {
         _inject.setLastError(BlynkInject::ERROR_NETWORK);
+        if (verifyFailed()) return;
 
         // If setting not saved -> return to config mode
         if (!_store.isSaved()) {
@@ -194,43 +765,80 @@ private:
   }
 
   void stateConnectingCloud() {
+    EDGENT_TRACE_SCOPE("Edgent::stateConnectingCloud");
     if (isEnteringState()) {
-      Particle.connect();
+      if (_injectVerifying) {
+        _inject.reportProgress("cloud");
+      }
+      if (_particlePolicy == PARTICLE_CLOUD_ALWAYS) {
+        Particle.connect();
+      }
 
-      Blynk.config(_store.getBlynkAuth().c_str(),
-                   _store.getBlynkHost().c_str());
+      configBlynk();
       Blynk.connect(0); // Start connecting, wait 0ms
 
       setStateEntered();
     }
 
-    Blynk.run();
+    {
+      EDGENT_MEM_SCOPE(MEM_BLYNK);
+      EDGENT_TRACE_SCOPE("Blynk.run");
+      Blynk.run();
+    }
 
     if (Blynk.connected()) {
       if (!_store.isSaved()) {
         _inject.setLastError(BlynkInject::ERROR_NONE);
-        _store.commit();
+        {
+          EDGENT_MEM_SCOPE(MEM_CONFIG);
+          _store.commit();
+        }
 
         BLYNK_LOG1(F("Config saved."));
+        verifySucceeded();
 
         if (_onInitialConnection) { _onInitialConnection(); }
       }
       _retriesCloud = WIFI_CLOUD_MAX_RETRIES;
+      _usage.setInterface(NetMgr.getConnectedInterface());
+      _usage.add(DataUsage::USAGE_PROTOCOL, USAGE_CONNECT_BYTES / 2, USAGE_CONNECT_BYTES / 2);
+      systemStats.latency.time_to_cloud.add(millis() - _stateEnterTime);
       systemStats.trackConnected();
       setState(MODE_RUNNING);
 
+      systemStats.shadow.resynced += _shadow.resync([this](uint8_t pin, const char* value) {
+        sendValue(pin, value);
+      });
+
+#if defined(CONFIG_COMPRESSION) && defined(COMPRESSION_PEER_PIN)
+      Blynk.syncVirtual(COMPRESSION_PEER_PIN);
+      _usage.addMessage(DataUsage::USAGE_PROTOCOL, writeSize(COMPRESSION_PEER_PIN, 0));
+#endif
+
+      if (systemCrash.hasDump && !systemCrash.reported) {
+        char buff[100];
+        systemCrash.describe(buff, sizeof(buff));
+        logEvent("sys_crash", buff);
+        systemCrash.reported = true;
+        retainedChanged();
+      }
+
       if (_onStartupConnection) {
         String curr_fw = BLYNK_FIRMWARE_VERSION;
         String prev_fw = _store.getFirmwareVer();
         if (curr_fw != prev_fw) {
           if (prev_fw.length()) {
-            Blynk.logEvent("sys_ota", String("Firmware updated from ") + prev_fw + " to " + curr_fw);
+            logEvent("sys_ota", String("Firmware updated from ") + prev_fw + " to " + curr_fw);
+            // The image came through Particle Cloud, its size is not known here
+            _usage.add(DataUsage::USAGE_PARTICLE, 0, PARTICLE_CLOUD_OTA_BYTES);
           }
           _store.storeFirmwareVer(curr_fw);
         }
 
-        Blynk.sendInternal("meta", "set", "Device UID",   systemGetDeviceUID());
-        Blynk.sendInternal("meta", "set", "Hotspot Name", systemGetDeviceName());
+        if (_usage.allowsMetadata()) {
+          sendInternal("meta", "set", "Device UID",   systemGetDeviceUID());
+          sendInternal("meta", "set", "Hotspot Name", systemGetDeviceName());
+        }
 
         if (_onStartupConnection != (callback0_t)1) {
           _onStartupConnection();
@@ -242,13 +850,19 @@ private:
       if (!_store.isSaved()) {
         _inject.setLastError(BlynkInject::ERROR_TOKEN);
       }
+      if (verifyFailed()) return;
       setState(MODE_WAIT_CONFIG); // TODO: retry after timeout
     } else if (!NetMgr.isAnyConnected()) {
       setState(MODE_CONNECTING_NET);
     } else if (millis() - _stateChangeTime > WIFI_NET_CONNECT_TIMEOUT) {
       BLYNK_LOG1(F("Cloud connection timeout"));
+      if (_hostAddrInUse) {
+        // Fall back to the fresh DNS resolution
+        _hostAddr = IPAddress();
+      }
       if (--_retriesCloud <= 0) {
         _inject.setLastError(BlynkInject::ERROR_CLOUD);
+        if (verifyFailed()) return;
 
         // If setting not saved -> return to config mode
         if (!_store.isSaved()) {
@@ -263,7 +877,9 @@ private:
   }
 
   void stateRunning() {
+    EDGENT_TRACE_SCOPE("Edgent::stateRunning");
     if (!Blynk.connected()) {
+      _link.reset();
       systemStats.trackDisconnected();
       if (NetMgr.isAnyConnected()) {
         systemStats.cloud_drops++;
@@ -273,10 +889,24 @@ private:
         setState(MODE_CONNECTING_NET);
       }
     }
-    Blynk.run();
+    {
+      EDGENT_MEM_SCOPE(MEM_BLYNK);
+      EDGENT_TRACE_SCOPE("Blynk.run");
+      const uint32_t now = millis();
+      _blynkRunPeriod = now - _blynkRunLast;
+      _blynkRunLast = now;
+      Blynk.run();
+    }
+
+    if (Blynk.connected()) {
+      _outbox.run([this](uint8_t cmd, const void* data, size_t len) {
+        sendCmd(cmd, data, len);
+      });
+    }
   }
 
   void stateResetConfig() {
+    EDGENT_TRACE_SCOPE("Edgent::stateResetConfig");
     BLYNK_LOG1(F("Resetting configuration!"));
     _store.erase();
     //NetMgr.clearAllNetworks();
@@ -284,6 +914,7 @@ private:
   }
 
   void stateError() {
+    EDGENT_TRACE_SCOPE("Edgent::stateError");
     if (millis() - _stateChangeTime > 10000) {
       BLYNK_LOG1(F("Restarting after error."));
       systemReboot();
@@ -312,6 +943,11 @@ public:
     _onConfigChange = f;
   }
 
+  // Chained from the InternalPinRTC handler, with the server time (UTC ms)
+  void onServerTimeReceived(serverTime_t f) {
+    _onServerTime = f;
+  }
+
   State getState() { return _state; }
 
   void setState(State m, bool reenter = false) {
@@ -320,19 +956,37 @@ public:
     if (_state != m || reenter) {
       BLYNK_LOG3(getStateName(_state), " => ", getStateName(m));
       _prevState = (reenter) ? MODE_MAX_VALUE : _state;
+      if (_state != m) {
+        _stateEnterTime = millis();   // Not reset by retries
+      }
       _state = m;
       _stateChangeTime = millis();
+      retainedChanged();
 
       if (_onStateChange) { _onStateChange(); }
     }
   }
 
   void startConfig() {
+    if (_configConcurrent && isConfigured()) {
+      // Keep the current connection, just start BLE
+      if (!_injectConcurrent && _state != MODE_WAIT_CONFIG) {
+        BLYNK_LOG1(F("Starting concurrent configuration"));
+        beginInject();
+        _injectConcurrent = true;
+        _injectStartTime = millis();
+      }
+      return;
+    }
     Blynk.disconnect();
     setState(MODE_WAIT_CONFIG);
   }
 
   void stopConfig() {
+    if (_injectConcurrent) {
+      endInject();
+      return;
+    }
     if (_store.isConfigured() && !_isTokenInvalid) {
       setState(MODE_CONNECTING_NET);
     } else {
@@ -362,53 +1016,918 @@ public:
     }
   }
 
+  void connectParticleCloud(uint32_t window = PARTICLE_CLOUD_WINDOW) {
+    if (_particlePolicy != PARTICLE_CLOUD_ON_DEMAND) return;
+    BLYNK_LOG2(F("Connecting Particle Cloud for (s): "), window);
+    _particleWindowStart = millis();
+    _particleWindow = window;
+    Particle.connect();
+  }
+
+  void disconnectParticleCloud() {
+    if (_particlePolicy == PARTICLE_CLOUD_ALWAYS) return;
+    _particleWindow = 0;
+    Particle.disconnect();
+  }
+
+  // Estimated Particle Cloud traffic saved by the policy, per day
+  uint32_t getParticleCloudSavings() {
+    const uint32_t uptime = systemUptime() / 1000;
+    if (!uptime) return 0;
+    const uint64_t saved =
+        (uint64_t)_particleStats.handshakes_skipped * PARTICLE_CLOUD_HANDSHAKE_BYTES +
+        (uint64_t)_particleStats.offline_secs * PARTICLE_CLOUD_KEEPALIVE_BYTES / PARTICLE_CLOUD_KEEPALIVE_SECS;
+    return saved * 86400 / uptime;
+  }
+
   BlynkConsole&         getConsole()      { return _console; }
   BlynkInject::Config&  getInjectConfig() { return _inject._config; }
 
 private:
 
   static void provisionCb();
+  static void telemetryFlushCb();
+  static void samplerTickCb();
+
+  void samplerTick() {
+    if (_sampler.isEmpty()) return;
+    _sampler.run([this](uint8_t pin, float value, uint64_t ts) {
+      if (!ts) {
+        virtualWrite(pin, value);
+        return;
+      }
+      // Downsampled series keeps the original sample time
+      char buff[TELEMETRY_VALUE_SIZE];
+      BlynkParam param(buff, 0, sizeof(buff));
+      param.add(value);
+      if (param.getLength()) {
+        queueTelemetry(pin, buff, ts);
+      }
+    });
+  }
 
-  void provisioned() {
-    if (_inject._config.intf == "wifi") {
-#ifdef NetMgr_WiFi
-      // TODO: static IP
-      NetMgrWiFi.addNetwork(_inject._config.ssid, _inject._config.pass);
+  bool hasQueuedTelemetry() {
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+    if (!_journal.isEmpty()) return true;
 #endif
-    }
-    _store.setBlynkHost(_inject._config.host);
-    _store.setBlynkAuth(_inject._config.auth);
-
-    if (_onConfigChange) { _onConfigChange(); }
-
-    startInitialConnection();
+    return !_telemetry.isEmpty();
   }
 
-  void printBanner()
-  {
-#ifdef BLYNK_PRINT
-    Blynk.printBanner();
-    BLYNK_LOG("----------------------------------------------------");
-    BLYNK_LOG(" Device:    %s", systemGetDeviceName().c_str());
-    BLYNK_LOG(" Version:   %s (build %s)", BLYNK_FIRMWARE_VERSION, __DATE__ " " __TIME__);
-    BLYNK_LOG(" UID:       %s", systemGetDeviceUID().c_str());
-    if (_store.isConfigured()) {
-      BLYNK_LOG(" Token:     %s - •••• - •••• - ••••", _store.getBlynkAuth().substring(0,4).c_str());
-    }
-    BLYNK_LOG(" Platform:  %s", BLYNK_INFO_DEVICE);
-    BLYNK_LOG("----------------------------------------------------");
+  // A live value must not overtake older values of the same pin.
+  // Journal contents are not indexed, so any journal record counts
+  bool hasQueuedTelemetry(uint8_t pin) {
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+    if (!_journal.isEmpty()) return true;
 #endif
+    return _telemetry.contains(pin);
   }
 
-private:
+  /*
+   * Memory
+   */
 
-  BlynkTimer    _timer;
-  BlynkConsole  _console;
-  BlynkInject   _inject;
-  ConfigStore   _store;
+  static void memorySampleCb();
+
+  void memorySample() {
+    _memory.sample();
+    if (systemCrash.context.minHeap != _memory.getStats().minFree) {
+      systemCrash.context.minHeap = _memory.getStats().minFree;
+      retainedChanged();
+    }
+  }
+
+  /*
+   * Retained RAM
+   */
+
+  // Where retained RAM is saved only on a graceful reset (Photon 2, P2),
+  // changes are synced, so the crash context and the stats survive a panic.
+  // Each sync writes to flash: it is done at most every RETAINED_SYNC_INTERVAL,
+  // unless urgent
+  void retainedChanged(bool urgent = false) {
+#if defined(PARTICLE) && HAL_PLATFORM_BACKUP_RAM_NEED_SYNC
+    _retainedDirty = true;
+    if (urgent) {
+      _retainedSyncTime = millis() - RETAINED_SYNC_INTERVAL * 1000UL;
+    }
+    retainedSync();
+#else
+    (void)urgent;
+#endif
+  }
+
+  void retainedSync() {
+#if defined(PARTICLE) && HAL_PLATFORM_BACKUP_RAM_NEED_SYNC
+    if (_retainedDirty && millis() - _retainedSyncTime >= RETAINED_SYNC_INTERVAL * 1000UL) {
+      _retainedDirty = false;
+      _retainedSyncTime = millis();
+      System.backupRamSync();
+    }
+#endif
+  }
+
+  /*
+   * Stats persistence
+   */
+
+  // {"net":{"n":..,"p50":..,"p95":..,"p99":..,"h":[..]},"cloud":..,"online":..,"offline":..,"rtt":..,"cmd":..}
+  // Calls f(name, histogram) for each latency histogram
+  template <typename F>
+  static void forEachLatency(F f) {
+    f("net",     systemStats.latency.time_to_net);
+    f("cloud",   systemStats.latency.time_to_cloud);
+    f("online",  systemStats.latency.online_session);
+    f("offline", systemStats.latency.offline_gap);
+    f("rtt",     systemStats.latency.cloud_rtt);
+    f("cmd",     systemStats.latency.command);
+  }
+
+  static void writeLatencyStats(JsonWriter& w) {
+    w.beginObject();
+    forEachLatency([&w](const char* name, const LogHistogram& h) {
+      w.name(name);
+      w.beginObject();
+      w["n"]   = h.count();
+      w["p50"] = h.percentile(50);
+      w["p95"] = h.percentile(95);
+      w["p99"] = h.percentile(99);
+      // Buckets up to the last used one
+      unsigned used = LOG_HISTOGRAM_BUCKETS;
+      while (used && !h.buckets[used - 1]) used--;
+      w.name("h");
+      w.beginArray();
+      for (unsigned i = 0; i < used; i++) {
+        w.value(unsigned(h.buckets[i]));
+      }
+      w.endArray();
+      w.endObject();
+    });
+    w.endObject();
+  }
+
+  /*
+   * Diagnostics snapshot
+   */
+
+  static void diagSnapshotCb();
+
+  // Compact, mostly columnar. Arrays keep the order of the fields:
+  //   rst:  [total, graceful, last reason code]
+  //   rr:   [[code, count], ...]
+  //   drop: [network, cloud]
+  //   on:   [total, max] s, off: the same
+  //   lat:  {"net":[n, p50, p95, p99], "cloud", "online", "offline", "rtt", "cmd"}
+  //   link: [srtt, rttvar, lost probes, avg command latency] ms
+  //   heap: [free, min free, min largest block]
+  //   loop: [stalls, max stall ms]
+  //   tlm:  [queued, dropped, flushed], obx: [dropped, max depth]
+  //   use:  [cellular bytes today, this month, governor level]
+  // Without `full`, the optional sections (reset reasons, latencies) are left out
+  void writeDiagSnapshot(JsonWriter& w, bool full = true) {
+    w.beginObject();
+    w["v"]  = 1;
+    w["up"] = uint32_t(systemUptime() / 1000);
+    w["if"] = NetMgr.getConnectedInterface();
+#if defined(NetMgr_WiFi)
+    if (NetMgrWiFi.isConnected()) {
+      w["rssi"] = NetMgrWiFi.getRSSI();
+    }
+#endif
+#if defined(NetMgr_Cellular)
+    if (NetMgrCellular.isConnected()) {
+      w["sig"] = NetMgrCellular.getSignalStrength();
+    }
+#endif
+
+    w.name("rst").beginArray()
+      .value(systemStats.resetCount.total)
+      .value(systemStats.resetCount.graceful)
+      .value(systemGetResetCode())
+      .endArray();
+    if (full) {
+      w.name("rr").beginArray();
+      for (unsigned i = 0; i < SYSTEM_RESET_REASON_SLOTS; i++) {
+        if (systemStats.resetReasons[i].count) {
+          w.beginArray()
+            .value(int(systemStats.resetReasons[i].code))
+            .value(unsigned(systemStats.resetReasons[i].count))
+            .endArray();
+        }
+      }
+      w.endArray();
+    }
+    w.name("drop").beginArray()
+      .value(systemStats.network_drops)
+      .value(systemStats.cloud_drops)
+      .endArray();
+    w.name("on").beginArray()
+      .value(systemStats.total_online_time)
+      .value(systemStats.max_online_time)
+      .endArray();
+    w.name("off").beginArray()
+      .value(systemStats.total_offline_time)
+      .value(systemStats.max_offline_time)
+      .endArray();
+
+    if (full) {
+      w.name("lat").beginObject();
+      forEachLatency([&w](const char* name, const LogHistogram& h) {
+        w.name(name).beginArray()
+          .value(h.count())
+          .value(h.percentile(50))
+          .value(h.percentile(95))
+          .value(h.percentile(99))
+          .endArray();
+      });
+      w.endObject();
+    }
+
+    const MemoryMonitor::Stats& mem = _memory.getStats();
+    const LinkMonitor::Stats& link = _link.getStats();
+    w.name("link").beginArray()
+      .value(link.srtt)
+      .value(link.rttvar)
+      .value(link.lost)
+      .value(link.avgCommand)
+      .endArray();
+
+    w.name("heap").beginArray()
+      .value(MemoryMonitor::readHeap().free)
+      .value(mem.minFree)
+      .value(mem.minLargest)
+      .endArray();
+    w["stack"] = MemoryMonitor::getAppStack().used;
+    w.name("loop").beginArray()
+      .value(systemStats.loop.stalls)
+      .value(systemStats.loop.max_stall)
+      .endArray();
+    w.name("tlm").beginArray()
+      .value(systemStats.telemetry.queued)
+      .value(systemStats.telemetry.dropped)
+      .value(systemStats.telemetry.flushed)
+      .endArray();
+    w.name("obx").beginArray()
+      .value(_outbox.getStats().dropped)
+      .value(_outbox.getStats().maxDepth)
+      .endArray();
+    w.name("use").beginArray()
+      .value(DataUsage::total(_usage.getDaily(), DataUsage::IF_CELLULAR))
+      .value(DataUsage::total(_usage.getMonthly(), DataUsage::IF_CELLULAR))
+      .value(unsigned(_usage.getLevel()))
+      .endArray();
+    w.endObject();
+  }
+
+  bool sendDiagSnapshot() {
+#if defined(DIAG_SNAPSHOT_PIN)
+    if (!_usage.allowsMetadata()) {
+      return false;
+    }
+    // Not on the stack, this runs in a timer callback
+    static char buff[DIAG_SNAPSHOT_BUFFER_SIZE];
+    JsonBufferWriter writer(buff, sizeof(buff));
+    writeDiagSnapshot(writer);
+    size_t len = writer.dataSize();
+    if (len > sizeof(buff)) {
+      BLYNK_LOG1(F("Diagnostics snapshot is too large, sending the short one"));
+      JsonBufferWriter shortWriter(buff, sizeof(buff));
+      writeDiagSnapshot(shortWriter, false);
+      len = shortWriter.dataSize();
+      if (len > sizeof(buff)) {
+        return false;
+      }
+    }
+    return virtualWriteCompressed(DIAG_SNAPSHOT_PIN, buff, len);
+#else
+    return false;
+#endif
+  }
+
+  void loadStats() {
+    if (systemStats.isColdStart()) {
+      // Retained RAM was lost, continue from the last checkpoint
+      uint8_t buff[sizeof(SystemStats)];
+      const size_t len = _store.loadStats(buff, sizeof(buff));
+      if (len && systemStats.restore(buff, len)) {
+        BLYNK_LOG1(F("Stats restored from checkpoint"));
+      }
+    }
+    systemStats.trackReset(systemGetResetCode());
+    systemCrash.begin();
+    // The reset histogram and the consumed crash context
+    retainedChanged(true);
+
+    uint8_t buff[sizeof(DataUsage)];
+    const size_t len = _store.loadUsage(buff, sizeof(buff));
+    if (len) {
+      _usage.restore(buff, len);
+    }
+    applyUsageLevel();
+  }
+
+  /*
+   * Data usage
+   */
+
+  static void usageTickCb();
+
+  void usageTick() {
+    if (Blynk.connected()) {
+      _usage.setInterface(NetMgr.getConnectedInterface());
+      // Heartbeat: ping and its response
+      if (++_usageHeartbeatSecs >= BLYNK_HEARTBEAT) {
+        _usageHeartbeatSecs = 0;
+        _usage.addMessage(DataUsage::USAGE_PROTOCOL, 0);
+        _usage.add(DataUsage::USAGE_PROTOCOL, 0, DataUsage::HEADER_SIZE);
+      }
+    }
+#if defined(PARTICLE)
+    const bool particle = Particle.connected();
+    if (particle && !_usageParticleConnected) {
+      _usageParticleSecs = 0;
+      _usage.add(DataUsage::USAGE_PARTICLE, PARTICLE_CLOUD_HANDSHAKE_BYTES / 2,
+                                            PARTICLE_CLOUD_HANDSHAKE_BYTES / 2);
+    } else if (particle && ++_usageParticleSecs >= PARTICLE_CLOUD_KEEPALIVE_SECS) {
+      _usageParticleSecs = 0;
+      _usage.add(DataUsage::USAGE_PARTICLE, PARTICLE_CLOUD_KEEPALIVE_BYTES / 2,
+                                            PARTICLE_CLOUD_KEEPALIVE_BYTES / 2);
+    }
+    _usageParticleConnected = particle;
+#endif
+    if (_usage.rollover(_time.now() / 86400000UL)) {
+      _store.storeUsage(_usage.data(), _usage.size());
+    }
+    applyUsageLevel();
+  }
+
+  void applyUsageLevel() {
+    if (_usage.update()) {
+      BLYNK_LOG("Data usage %lu%% of the budget, level: %s",
+                (unsigned long)_usage.getBudgetUsed(),
+                DataUsage::getLevelName(_usage.getLevel()));
+    }
+    _sampler.setUploadScale(_usage.getScale());
+  }
+
+  static void statsCheckpointCb();
+
+  void statsCheckpoint() {
+    _store.storeStats(systemStats.data(), systemStats.size());
+    _store.storeUsage(_usage.data(), _usage.size());
+    retainedChanged(true);
+  }
+
+  /*
+   * Time sync
+   */
+
+  static void timeTickCb();
+
+  void timeTick() {
+#if defined(PARTICLE)
+    // Particle Cloud syncs the RTC on connect
+    const system_tick_t synced = Particle.timeSyncedLast();
+    if (synced && synced != _particleTimeSynced && Time.isValid()) {
+      _particleTimeSynced = synced;
+      timeSynced(uint64_t(Time.now()) * 1000, TimeService::SOURCE_PARTICLE);
+    }
+#endif
+    // Server time requests also measure the RTT, so are sent more often
+    // if RTT probes are enabled (and less often when saving data).
+    // The reply to the ping is not passed on by the library, so a probe
+    // sent at the heartbeat rate takes its place
+    uint32_t interval = TIME_SYNC_INTERVAL;
+    if (RTT_PROBE_INTERVAL) {
+      interval = BlynkMin<uint32_t>(interval, RTT_PROBE_INTERVAL * _usage.getScale());
+    }
+    if (_state == MODE_RUNNING && Blynk.connected() &&
+        (!_timeRequested || millis() - _timeRequested >= interval * 1000UL))
+    {
+      _timeRequested = millis();
+      // Not deferred by the outbox, which would add to the RTT
+      static const char req[] = "rtc\0sync";
+      sendCmd(BLYNK_CMD_INTERNAL, req, sizeof(req) - 1);
+      _link.probeSent(_timeRequested);
+      // Keeps the link busy, so no ping goes out; the reply is about the same size
+      _usageHeartbeatSecs = 0;
+      _usage.add(DataUsage::USAGE_PROTOCOL, 0, DataUsage::HEADER_SIZE + sizeof(req));
+    }
+    _link.check(millis());
+  }
+
+  void timeSynced(uint64_t utc, TimeService::Source src) {
+    if (_time.sync(utc, src)) {
+      _store.storeTimeDrift(_time.getDrift());
+    }
+    // Keep the RTC set, so the time is known after a reset
+    if (src != TimeService::SOURCE_PARTICLE &&
+        (!Time.isValid() || abs(int32_t(Time.now() - utc / 1000)) > 1))
+    {
+      Time.setTime(utc / 1000);
+    }
+  }
+
+public:
+  // Called with the Blynk server time.
+  // Without CONFIG_SERVER_TIME_HANDLER, call it from your own InternalPinRTC handler
+  void onServerTime(uint64_t utc) {
+    _link.probeReceived(millis());
+    timeSynced(utc, TimeService::SOURCE_BLYNK);
+    if (_onServerTime) { _onServerTime(utc); }
+  }
+
+  // Call in BLYNK_WRITE (done by BLYNK_WRITE_SHADOW), with the time the command
+  // was issued (UTC ms) if it is sent along with the value.
+  // Only such commands are measured. The clock is synced to the second,
+  // so the measured latency is accurate to about 1 s.
+  // Without it, the latency is only estimated as half of the RTT,
+  // plus half of the period of the main loop (see LinkMonitor::Stats::estCommand)
+  void commandReceived(uint64_t issued = 0) {
+    const uint64_t now = issued ? _time.now() : 0;
+    if (now) {
+      _link.commandReceived((now > issued) ? uint32_t(now - issued) : 0);
+    } else {
+      _link.commandEstimated((_link.getStats().srtt + _blynkRunPeriod) / 2);
+    }
+  }
+
+  // Counts the data usage of an incoming pin write. Called by the Edgent
+  // handlers and BLYNK_WRITE_SHADOW, plain BLYNK_WRITE handlers can call it too
+  void inboundReceived(int pin, const BlynkParam& param,
+                       DataUsage::Class c = DataUsage::USAGE_TELEMETRY) {
+    const size_t len = param.getLength();
+    _usage.addInbound(c, writeSize(pin, len ? len - 1 : 0));
+  }
+
+  const LinkMonitor::Stats& getLinkStats() const {
+    return _link.getStats();
+  }
+
+  // UTC time (ms), 0 if unknown
+  uint64_t getUtcTime() {
+    return _time.now();
+  }
+
+private:
+
+  void sendTelemetry(uint8_t pin, uint64_t utc, const char* value) {
+    if (utc) {
+      // Restore the original timestamp
+      Blynk.beginGroup(utc);
+      Blynk.virtualWrite(pin, value);
+      Blynk.endGroup();
+      _usage.addMessage(DataUsage::USAGE_PROTOCOL, 16);
+      _usage.addMessage(DataUsage::USAGE_PROTOCOL, 3);
+    } else {
+      Blynk.virtualWrite(pin, value);
+    }
+    _usage.addMessage(DataUsage::USAGE_TELEMETRY, writeSize(pin, strlen(value)));
+    systemStats.telemetry.flushed++;
+  }
+
+  void telemetryFlush() {
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+    // Bounds the records lost on power failure to one flush interval
+    _journal.sync();
+#endif
+    if (!_filters.isEmpty()) {
+      _filters.poll(millis(), [this](uint8_t pin, const char* value) {
+        writeTelemetry(pin, value, false);
+      });
+    }
+
+    if (!_combiner.isEmpty() &&
+        (_state != MODE_RUNNING || millis() - _combinerStart >= getCoalesceWindow()))
+    {
+      flushCombiner();
+    }
+
+    if (_state != MODE_RUNNING) return;
+
+    sendQueuedTelemetry();
+  }
+
+  void sendQueuedTelemetry() {
+    // Journal holds older records, so it goes first
+    int sent = 0;
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+    TelemetryJournal::Record jrec;
+    while (sent < TELEMETRY_FLUSH_BATCH && _journal.peek(jrec)) {
+      uint64_t utc = 0;
+      if (jrec.flags & TelemetryJournal::FLAG_UTC) {
+        utc = jrec.ts;
+      } else if (jrec.seq >= _journalBootSeq) {
+        // Appended before the time was known, the uptime is from this boot
+        _time.toUtc(jrec.ts, utc);
+      }
+      if (!_outbox.acquire(Outbox::PRIO_TELEMETRY, utc ? Outbox::MAX_COST : 1)) break;
+      sendTelemetry(jrec.pin, utc, jrec.value);
+      _journal.pop();
+      sent++;
+    }
+    if (sent) {
+      _journal.commit();
+    }
+#endif
+    while (sent < TELEMETRY_FLUSH_BATCH && !_telemetry.isEmpty()) {
+      const TelemetryRecord& rec = _telemetry.front();
+      uint64_t utc = 0;
+      _time.toUtc(rec.ts, utc);
+      // Timestamped value takes 3 messages
+      if (!_outbox.acquire(Outbox::PRIO_TELEMETRY, utc ? Outbox::MAX_COST : 1)) break;
+      sendTelemetry(rec.pin, utc, rec.value);
+      _telemetry.pop();
+      sent++;
+    }
+  }
+
+  /*
+   * Blynk server address cache
+   */
+
+  bool isHostAddrValid() {
+    return ipIsValid(_hostAddr) &&
+           _store.getHostAddr(getServerHost()) == ipToString(_hostAddr);
+  }
+
+  void loadHostAddr() {
+#if BLYNK_DNS_CACHE_TTL
+    // Stored address is fresh only if the wall clock is known
+    const uint32_t expiry = _store.getHostAddrExpiry();
+    const uint32_t now = _time.now() / 1000;
+    const String addr = _store.getHostAddr(getServerHost());
+    if (addr.length() && expiry && now && expiry > now) {
+      _hostAddr = ipFromString(addr);
+      _hostAddrExpiry = millis() + (expiry - now) * 1000UL;
+    }
+#endif
+  }
+
+  void resolveHostAddr() {
+#if BLYNK_DNS_CACHE_TTL && !defined(CONFIG_USE_SSL)
+    if (isHostAddrValid() && int32_t(_hostAddrExpiry - millis()) > 0) {
+      return;
+    }
+    const String& host = getServerHost();
+    const String cached = _store.getHostAddr(host);
+    IPAddress addr = NetMgr.resolve(host);
+    if (ipIsValid(addr)) {
+      _hostAddr = addr;
+      _hostAddrExpiry = millis() + BLYNK_DNS_CACHE_TTL * 1000UL;
+      // The expiry is refreshed on every lookup (at most once per TTL),
+      // even if the address is the same
+      const String addrStr = ipToString(addr);
+      const uint32_t now = _time.now() / 1000;
+      if (addrStr != cached || now) {
+        _store.storeHostAddr(host, addrStr, now ? (now + BLYNK_DNS_CACHE_TTL) : 0);
+      }
+    } else if (cached.length()) {
+      // Use the last known address, but try resolving again next time
+      BLYNK_LOG1(F("DNS lookup failed, using cached address"));
+      _hostAddr = ipFromString(cached);
+      _hostAddrExpiry = millis();
+    }
+#endif
+  }
+
+  void configBlynk() {
+    const String& auth = _store.getBlynkAuth();
+#if BLYNK_DNS_CACHE_TTL && !defined(CONFIG_USE_SSL)
+    _hostAddrInUse = isHostAddrValid();
+    if (_hostAddrInUse) {
+      Blynk.config(auth.c_str(), _hostAddr, BLYNK_DEFAULT_PORT);
+      return;
+    }
+#endif
+    Blynk.config(auth.c_str(), getServerHost().c_str());
+  }
+
+  /*
+   * Regional server selection
+   */
+
+  const String& getServerHost() {
+#if defined(BLYNK_SERVER_CANDIDATES)
+    if (_store.getBlynkHost() == BLYNK_DEFAULT_SERVER &&
+        _store.getServerHost().length())
+    {
+      return _store.getServerHost();
+    }
+#endif
+    return _store.getBlynkHost();
+  }
+
+#if defined(BLYNK_SERVER_CANDIDATES)
+  static void serverProbeTickCb();
+
+  static String getServerCandidate(int idx) {
+    const char* p = BLYNK_SERVER_CANDIDATES;
+    while (true) {
+      while (*p == ' ') p++;
+      const char* end = strchr(p, ' ');
+      if (!end) end = p + strlen(p);
+      if (end == p) return "";
+      if (idx-- == 0) return String(p, end - p);
+      p = end;
+    }
+  }
+
+  // Returns TCP connect time in ms, 0 on failure or timeout
+  static uint32_t probeServer(const char* host) {
+    IPAddress addr = NetMgr.resolve(host);
+    if (!ipIsValid(addr)) {
+      return 0;
+    }
+    TCPClient client;
+    const uint32_t t = millis();
+    if (!client.connect(addr, BLYNK_DEFAULT_PORT)) {
+      return 0;
+    }
+    const uint32_t rtt = millis() - t;
+    client.stop();
+    if (rtt > BLYNK_SERVER_PROBE_TIMEOUT) {
+      return 0;
+    }
+    return rtt ? rtt : 1;
+  }
+
+  // DNS lookup and TCP connect may block for seconds,
+  // so each probe runs in a short-lived worker thread
+  static void serverProbeWorker(void* arg) {
+    Edgent* self = (Edgent*)arg;
+    self->_probeHostRTT = probeServer(self->_probeHost);
+    self->_probeBusy = false;
+    os_thread_exit(nullptr);
+  }
+
+  void startServerProbe() {
+    _probeIdx = 0;
+    _probeHost[0] = '\0';
+    _probeBestRTT = 0;
+    _probeBest = "";
+    _probeResult = "";
+  }
+
+  // The time of the last probe is stored as UTC, so the interval
+  // spans reboots. While the clock is unknown, it is counted from boot
+  bool serverProbeDue() {
+    const uint32_t now = _time.now() / 1000;
+    const uint32_t probed = _store.getServerProbeTime();
+    if (now && probed) {
+      return now - probed > BLYNK_SERVER_PROBE_INTERVAL;
+    }
+    if (_probeTime) {
+      return millis() - _probeTime > BLYNK_SERVER_PROBE_INTERVAL * 1000UL;
+    }
+    return !_store.getServerHost().length() ||
+           millis() > BLYNK_SERVER_PROBE_INTERVAL * 1000UL;
+  }
+
+  // Probes one server at a time, off the main loop
+  void serverProbeTick() {
+    if (_store.getBlynkHost() != BLYNK_DEFAULT_SERVER) return;
+
+    if (_probeIdx < 0) {
+      if (!serverProbeDue() || _state != MODE_RUNNING) return;
+      BLYNK_LOG1(F("Probing servers"));
+      startServerProbe();
+    }
+    if (_probeBusy) return;
+
+    // Collect the result of the previous probe
+    if (_probeHost[0]) {
+      const String host(_probeHost);
+      const uint32_t rtt = _probeHostRTT;
+      _probeHost[0] = '\0';
+      BLYNK_LOG4(host, F(": "), rtt, F("ms"));
+      if (rtt && (!_probeBestRTT || rtt < _probeBestRTT)) {
+        _probeBestRTT = rtt;
+        _probeBest = host;
+      }
+      if (_probeResult.length()) _probeResult += " ";
+      _probeResult += host + ":" + String(rtt);
+      _probeIdx++;
+    }
+    if (!NetMgr.isAnyConnected()) return;
+
+    const String host = getServerCandidate(_probeIdx);
+    if (host.length()) {
+      strncpy(_probeHost, host.c_str(), sizeof(_probeHost) - 1);
+      _probeHost[sizeof(_probeHost) - 1] = '\0';
+      _probeHostRTT = 0;
+      _probeBusy = true;
+      os_thread_t thread;
+      if (os_thread_create(&thread, "probe", OS_THREAD_PRIORITY_DEFAULT,
+                           serverProbeWorker, this, BLYNK_SERVER_PROBE_STACK) != 0)
+      {
+        _probeBusy = false;   // Recorded as failed on the next tick
+      }
+      return;
+    }
+
+    // Finished. The selected server is used for the next connection
+    _probeIdx = -1;
+    _probeTime = millis() | 1;
+    if (_probeBest.length()) {
+      BLYNK_LOG2(F("Selected server: "), _probeBest);
+      _store.storeServerHost(_probeBest, _probeResult, _time.now() / 1000);
+    }
+  }
+#endif
+  static void particleCloudTickCb();
+
+  void particleCloudTick() {
+    if (_particlePolicy == PARTICLE_CLOUD_ALWAYS) return;
+
+    // A Particle session would have been opened on each network connection
+    const bool netUp = NetMgr.isAnyConnected();
+    if (netUp && !_particleNetUp && !_particleWindow && !Particle.connected()) {
+      _particleStats.handshakes_skipped++;
+    }
+    _particleNetUp = netUp;
+
+    // Compared in seconds, the scaled interval overflows in ms
+    const uint32_t elapsed = (millis() - _particleWindowStart) / 1000;
+    if (_particleWindow) {
+      if (elapsed > _particleWindow &&
+          !System.updatesPending())
+      {
+        BLYNK_LOG1(F("Disconnecting Particle Cloud"));
+        disconnectParticleCloud();
+      }
+    } else if (_particlePolicy == PARTICLE_CLOUD_ON_DEMAND &&
+               _particleInterval && _state == MODE_RUNNING &&
+               elapsed > _particleInterval * _usage.getScale())
+    {
+      connectParticleCloud();
+    }
+
+    if (netUp && !Particle.connected()) {
+      _particleStats.offline_secs++;
+    }
+  }
+
+  void beginInject() {
+    _inject._config.host = BLYNK_DEFAULT_SERVER;
+
+    _inject.setProvisionCallback(provisionCb);
+    _inject.begin(systemGetDeviceName(),
+                  BLYNK_DEVICE_PREFIX,
+                  BLYNK_TEMPLATE_ID,
+                  BLYNK_FIRMWARE_TYPE,
+                  BLYNK_FIRMWARE_VERSION);
+  }
+
+  void endInject() {
+    _inject.end();
+    _injectConcurrent = false;
+    _injectVerifying = false;
+  }
+
+  static void injectEndCb();
+
+  void verifySucceeded() {
+    if (!_injectVerifying) return;
+    _inject.reportResult();
+    _injectVerifying = false;
+    _injectRollback = false;
+    _injectAddedSsid = "";
+    // Give BLE some time to deliver the result
+    _timer.setTimeout(1000L, injectEndCb);
+  }
+
+  // Report the failure over BLE, keeping the session open.
+  // If a working config was replaced, restore it and return true.
+  bool verifyFailed() {
+    if (!_injectVerifying) return false;
+    _inject.reportResult();
+    _injectVerifying = false;
+#ifdef NetMgr_WiFi
+    // Don't retry the failed network after a reboot
+    if (_injectAddedSsid.length()) {
+      NetMgrWiFi.removeNetwork(_injectAddedSsid);
+      _injectAddedSsid = "";
+    }
+#endif
+    if (!_injectRollback) return false;
+
+    BLYNK_LOG1(F("Restoring previous config"));
+    _injectRollback = false;
+    _isTokenInvalid = false;
+    _store.begin();
+    _injectConcurrent = true;
+    _injectStartTime = millis();
+    _retriesNet = _retriesCloud = WIFI_CLOUD_MAX_RETRIES;
+    setState(MODE_CONNECTING_NET);
+    return true;
+  }
+
+  void runConcurrentConfig() {
+    {
+      EDGENT_MEM_SCOPE(MEM_INJECT);
+      _inject.run();
+    }
+    if (_injectConcurrent && millis() - _injectStartTime > _configTimeoutMs) {
+      if (_inject.isUserConfiguring()) {
+        _injectStartTime = millis(); // restart timer
+        return;
+      }
+      endInject();
+    }
+  }
+
+  void provisioned() {
+    if (_injectConcurrent && Blynk.connected()) {
+      // New config received, only now drop the cloud session
+      Blynk.disconnect();
+      systemStats.trackDisconnected();
+    }
+
+    if (_inject._config.intf == "wifi") {
+#ifdef NetMgr_WiFi
+      // TODO: static IP
+      const bool known = NetMgrWiFi.hasNetwork(_inject._config.ssid);
+      if (NetMgrWiFi.addNetwork(_inject._config.ssid, _inject._config.pass) && !known) {
+        _injectAddedSsid = _inject._config.ssid;
+      }
+#endif
+    }
+    // Keep BLE session open until the new config is verified
+    _injectRollback = _injectConcurrent && _store.isSaved();
+    _injectConcurrent = false;
+    _injectVerifying = true;
+
+    _store.setBlynkHost(_inject._config.host);
+    _store.setBlynkAuth(_inject._config.auth);
+
+    if (_onConfigChange) { _onConfigChange(); }
+
+    startInitialConnection();
+  }
+
+  void printBanner()
+  {
+#ifdef BLYNK_PRINT
+    Blynk.printBanner();
+    BLYNK_LOG("----------------------------------------------------");
+    BLYNK_LOG(" Device:    %s", systemGetDeviceName().c_str());
+    BLYNK_LOG(" Version:   %s (build %s)", BLYNK_FIRMWARE_VERSION, __DATE__ " " __TIME__);
+    BLYNK_LOG(" UID:       %s", systemGetDeviceUID().c_str());
+    if (_store.isConfigured()) {
+      BLYNK_LOG(" Token:     %s - •••• - •••• - ••••", _store.getBlynkAuth().substring(0,4).c_str());
+    }
+    BLYNK_LOG(" Platform:  %s", BLYNK_INFO_DEVICE);
+    BLYNK_LOG("----------------------------------------------------");
+#endif
+  }
+
+private:
+
+  BlynkTimer    _timer;
+  BlynkConsole  _console;
+  BlynkInject   _inject;
+  ConfigStore   _store;
+  TelemetryQueue _telemetry;
+  WriteCombiner _combiner;
+  PinFilters    _filters;
+  Outbox        _outbox;
+  PinShadow     _shadow;
+  Sampler       _sampler;
+  TimeService   _time;
+  MemoryMonitor _memory;
+  uint32_t      _retainedSyncTime = 0;
+  bool          _retainedDirty = false;
+  LoopMonitor   _loop;
+  DataUsage     _usage;
+  LinkMonitor   _link;
+  uint32_t      _blynkRunLast = 0;
+  uint32_t      _blynkRunPeriod = 0;
+  UsageStream   _terminalMeter { _usage };
+  uint32_t      _usageHeartbeatSecs = 0;
+  uint32_t      _usageParticleSecs = 0;
+  bool          _usageParticleConnected = false;
+  uint32_t      _timeRequested = 0;
+  system_tick_t _particleTimeSynced = 0;
+#if defined(CONFIG_EDGE_RULES)
+  EdgeRules     _rules;
+  ruleWrite_t   _onRuleWrite = NULL;
+#endif
+  uint32_t      _combinerStart = 0;
+  uint32_t      _coalesceWindow = TELEMETRY_COALESCE_WINDOW;
+#if defined(CONFIG_COMPRESSION)
+  LzEncoder     _lzEncoder { NULL, NULL };
+  uint8_t       _lzBuff[COMPRESSION_BUFFER_SIZE];
+  bool          _peerLz = false;
+#endif
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+  TelemetryJournal _journal;
+  uint32_t      _journalBootSeq = 0;  // First record appended after boot
+#endif
 
   uint32_t      _stateChangeTime = 0;
+  uint32_t      _stateEnterTime = 0;
   State         _state          = MODE_MAX_VALUE;
+  int           _crashState     = -1;     // Last state named in systemCrash
   State         _prevState      = MODE_MAX_VALUE;
 
   int           _retriesNet     = WIFI_CLOUD_MAX_RETRIES;
@@ -416,12 +1935,45 @@ private:
   unsigned      _configTimeoutMs = 5*60*1000;
   unsigned      _configSkipLimit = 10;
   bool          _isTokenInvalid = false;
+  bool          _configConcurrent = false;
+  bool          _injectConcurrent = false;
+  bool          _injectVerifying = false;
+  bool          _injectRollback = false;
+  bool          _injectLinkUp = false;
+  uint32_t      _injectStartTime = 0;
+  String        _injectAddedSsid;     // Removed if the verification fails
+
+#if defined(BLYNK_SERVER_CANDIDATES)
+  int           _probeIdx = -1;
+  uint32_t      _probeTime = 0;
+  uint32_t      _probeBestRTT = 0;
+  String        _probeBest;
+  String        _probeResult;
+  char          _probeHost[64] = {};
+  volatile uint32_t _probeHostRTT = 0;
+  volatile bool _probeBusy = false;
+#endif
+
+  IPAddress     _hostAddr;
+  uint32_t      _hostAddrExpiry = 0;
+  bool          _hostAddrInUse  = false;
+
+  ParticleCloud _particlePolicy   = PARTICLE_CLOUD_ALWAYS;
+  uint32_t      _particleInterval = 0;
+  uint32_t      _particleWindow   = 0;
+  uint32_t      _particleWindowStart = 0;
+  bool          _particleNetUp    = false;
+  struct {
+    uint32_t handshakes_skipped;
+    uint32_t offline_secs;
+  } _particleStats = { 0, 0 };
 
   callback0_t   _onStateChange       = NULL;
   callback0_t   _onInitialConnection = NULL;
   callback0_t   _onStartupConnection = (callback0_t)1;
   callback0_t   _onUserInitiatedReboot = NULL;
   callback0_t   _onConfigChange = NULL;
+  serverTime_t  _onServerTime = NULL;
 
   bool isEnteringState() { return _state != _prevState; }
   void setStateEntered() { _prevState = _state; }
@@ -432,9 +1984,196 @@ void Edgent::provisionCb() {
   BlynkEdgent.provisioned();
 }
 
+#if defined(BLYNK_SERVER_CANDIDATES)
+void Edgent::serverProbeTickCb() {
+  BlynkEdgent.serverProbeTick();
+}
+#endif
+
+void Edgent::telemetryFlushCb() {
+  BlynkEdgent.telemetryFlush();
+}
+
+void Edgent::timeTickCb() {
+  BlynkEdgent.timeTick();
+}
+
+void Edgent::statsCheckpointCb() {
+  BlynkEdgent.statsCheckpoint();
+}
+
+void Edgent::memorySampleCb() {
+  BlynkEdgent.memorySample();
+}
+
+void Edgent::usageTickCb() {
+  BlynkEdgent.usageTick();
+}
+
+void Edgent::diagSnapshotCb() {
+  BlynkEdgent.sendDiagSnapshot();
+}
+
+MemoryMonitor::Subsystem      MemoryMonitor::current = MemoryMonitor::MEM_OTHER;
+MemoryMonitor::SubsystemStats MemoryMonitor::subsystems[MemoryMonitor::MEM_COUNT];
+#if defined(PARTICLE)
+os_thread_t                   MemoryMonitor::appThread = NULL;
+#endif
+
+#if defined(CONFIG_MEM_ACCOUNTING)
+// Each block is prefixed with its size and owner, so a free is credited
+// to the subsystem that made the allocation. Blocks without the tag
+// (i.e. allocated by the system firmware) are passed through.
+// Blocks must not be freed by the system firmware
+static const size_t   MEM_HEADER_SIZE = 8;
+static const uint32_t MEM_TAG         = 0xED600000;
+
+extern "C" {
+
+void* __real_malloc(size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void  __real_free(void* ptr);
+
+static void* memAccount(uint32_t* block, size_t size) {
+  const MemoryMonitor::Subsystem owner = MemoryMonitor::owner();
+  block[0] = size;
+  block[1] = MEM_TAG | owner;
+  MemoryMonitor::SubsystemStats& st = MemoryMonitor::subsystems[owner];
+  __atomic_fetch_add(&st.allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&st.heapDelta, int32_t(size), __ATOMIC_RELAXED);
+  return block + MEM_HEADER_SIZE / sizeof(uint32_t);
+}
+
+// Returns the block, or NULL if not tagged
+static uint32_t* memRelease(void* ptr) {
+  uint32_t* block = (uint32_t*)ptr - MEM_HEADER_SIZE / sizeof(uint32_t);
+  const uint32_t owner = block[1] - MEM_TAG;
+  if (owner >= MemoryMonitor::MEM_COUNT) {
+    return NULL;
+  }
+  MemoryMonitor::SubsystemStats& st = MemoryMonitor::subsystems[owner];
+  __atomic_fetch_add(&st.frees, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&st.heapDelta, int32_t(block[0]), __ATOMIC_RELAXED);
+  return block;
+}
+
+void* __wrap_malloc(size_t size) {
+  uint32_t* block = (uint32_t*)__real_malloc(size + MEM_HEADER_SIZE);
+  return block ? memAccount(block, size) : NULL;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  const size_t total = count * size;
+  if (size && total / size != count) {
+    return NULL;
+  }
+  void* ptr = __wrap_malloc(total);
+  if (ptr) {
+    memset(ptr, 0, total);
+  }
+  return ptr;
+}
+
+void __wrap_free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  uint32_t* block = memRelease(ptr);
+  __real_free(block ? block : ptr);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  if (!ptr) {
+    return __wrap_malloc(size);
+  }
+  if (!size) {
+    __wrap_free(ptr);
+    return NULL;
+  }
+  uint32_t* block = (uint32_t*)ptr - MEM_HEADER_SIZE / sizeof(uint32_t);
+  const uint32_t owner = block[1] - MEM_TAG;
+  if (owner >= MemoryMonitor::MEM_COUNT) {
+    return __real_realloc(ptr, size);
+  }
+  // Credited back only once the block is moved or resized
+  uint32_t* moved = (uint32_t*)__real_realloc(block, size + MEM_HEADER_SIZE);
+  if (!moved) {
+    return NULL;
+  }
+  MemoryMonitor::SubsystemStats& st = MemoryMonitor::subsystems[owner];
+  __atomic_fetch_add(&st.frees, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&st.heapDelta, int32_t(moved[0]), __ATOMIC_RELAXED);
+  return memAccount(moved, size);
+}
+
+}
+#endif
+
+void Edgent::samplerTickCb() {
+  BlynkEdgent.samplerTick();
+}
+
+void Edgent::particleCloudTickCb() {
+  BlynkEdgent.particleCloudTick();
+}
+
+#if defined(CONFIG_EDGE_RULES)
+void Edgent::ruleWriteCb(uint8_t pin, float value) {
+  if (BlynkEdgent._onRuleWrite) {
+    BlynkEdgent._onRuleWrite(pin, value);
+  }
+  BlynkEdgent.virtualWrite(pin, value);
+}
+
+void Edgent::ruleEventCb(const char* event) {
+  BlynkEdgent.logEvent(event);
+}
+#endif
+
+void Edgent::injectEndCb() {
+  if (BlynkEdgent.getState() != Edgent::MODE_WAIT_CONFIG &&
+      !BlynkEdgent._injectVerifying && !BlynkEdgent._injectConcurrent)
+  {
+    BlynkEdgent.endInject();
+  }
+}
+
 #include <BlynkEdgentConsole.h>
 
+// Same as BLYNK_WRITE, but skipped if the value matches the local pin shadow
+#define BLYNK_WRITE_SHADOW(vpin) \
+  static void BlynkShadowWrite ## vpin (BlynkReq& request, const BlynkParam& param); \
+  BLYNK_WRITE(vpin) { \
+    BlynkEdgent.commandReceived(); \
+    if (BlynkEdgent.shadowReceive(request.pin, param)) { \
+      BlynkShadowWrite ## vpin (request, param); \
+    } \
+  } \
+  static void BlynkShadowWrite ## vpin (BlynkReq BLYNK_UNUSED &request, const BlynkParam BLYNK_UNUSED &param)
+
 BLYNK_WRITE(InternalPinDBG) {
+  BlynkEdgent.inboundReceived(request.pin, param, DataUsage::USAGE_TERMINAL);
   BlynkEdgent.getConsole().runCommand(param.asStr());
 }
 
+#if defined(CONFIG_SERVER_TIME_HANDLER)
+// Server time, requested with "rtc sync"
+BLYNK_WRITE(InternalPinRTC) {
+  BlynkEdgent.onServerTime(uint64_t(param[0].asLongLong()) * 1000);
+}
+#endif
+
+#if defined(CONFIG_COMPRESSION) && defined(COMPRESSION_PEER_PIN)
+BLYNK_WRITE(COMPRESSION_PEER_PIN) {
+  BlynkEdgent.inboundReceived(request.pin, param, DataUsage::USAGE_PROTOCOL);
+  BlynkEdgent.setPeerCapabilities(param.asStr());
+}
+#endif
+
+#if defined(CONFIG_EDGE_RULES) && defined(EDGE_RULES_PIN)
+BLYNK_WRITE(EDGE_RULES_PIN) {
+  BlynkEdgent.inboundReceived(request.pin, param, DataUsage::USAGE_PROTOCOL);
+  BlynkEdgent.setRules(param.asStr());
+}
+#endif
+
@@ -31,12 +31,13 @@ void Edgent::initConsoleCommands() {
 
   _console.addCommand("devinfo", [this]() {
     _console.printf(
-        R"json({"name":"%s","board":"%s","tmpl_id":"%s","fw_type":"%s","fw_ver":"%s"})json" "\n",
+        R"json({"name":"%s","board":"%s","tmpl_id":"%s","fw_type":"%s","fw_ver":"%s","caps":"%s"})json" "\n",
         systemGetDeviceName().c_str(),
         BLYNK_TEMPLATE_NAME,
         BLYNK_TEMPLATE_ID,
         BLYNK_FIRMWARE_TYPE,
-        BLYNK_FIRMWARE_VERSION
+        BLYNK_FIRMWARE_VERSION,
+        getCapabilities()
     );
   });
 
@@ -100,24 +101,324 @@ void Edgent::initConsoleCommands() {
     }
   });
 
+#if defined(BLYNK_SERVER_CANDIDATES)
+  _console.addCommand("server", [this](const BlynkParam &param) {
+    const String cmd = param[0].asStr();
+    if (!param[0].isValid() || cmd == "info") {
+      _console.printf(" Current:   %s\n", getServerHost().c_str());
+      _console.printf(" Probed:    %s\n", _store.getServerRTT().c_str());
+    } else if (cmd == "probe") {
+      startServerProbe();
+    } else {
+      _console.getStream().println(F("Available commands: info, probe"));
+    }
+  });
+#endif
+
+#if defined(PARTICLE)
+  _console.addCommand("particle", [this](const BlynkParam &param) {
+    const String cmd = param[0].asStr();
+    if (!param[0].isValid() || cmd == "info") {
+      static const char* policyStr[] = { "never", "on-demand", "always" };
+      _console.printf(" Policy:          %s\n",        policyStr[_particlePolicy]);
+      _console.printf(" Connected:       %s\n",        Particle.connected() ? "yes" : "no");
+      _console.printf(" Skipped:         %lu\n",       _particleStats.handshakes_skipped);
+      _console.printf(" Offline:         %s\n",        timeSpanToStr(_particleStats.offline_secs).c_str());
+      _console.printf(" Saved (est.):    %lu bytes/day\n", getParticleCloudSavings());
+    } else if (cmd == "connect") {
+      connectParticleCloud(param[1].isValid() ? param[1].asInt() : PARTICLE_CLOUD_WINDOW);
+    } else if (cmd == "disconnect") {
+      disconnectParticleCloud();
+    } else {
+      _console.getStream().println(F("Available commands: info, connect [secs], disconnect"));
+    }
+  });
+#endif
+
+#if defined(CONFIG_EDGE_RULES)
+  _console.addCommand("rules", [this](int argc, const char** argv) {
+    if (argc < 1 || 0 == strcmp(argv[0], "list")) {
+      char buff[512];
+      _rules.print(buff, sizeof(buff));
+      _console.print(buff);
+    } else if (0 == strcmp(argv[0], "add") && argc > 1) {
+      char buff[128];
+      size_t len = 0;
+      for (int i = 1; i < argc && len < sizeof(buff); i++) {
+        len += snprintf(buff + len, sizeof(buff) - len, "%s ", argv[i]);
+      }
+      if (len >= sizeof(buff)) {
+        _console.printf("Error: rule too long\n");
+      } else if (!addRules(buff)) {
+        _console.printf("Error: %s\n", _rules.getError());
+      }
+    } else if (0 == strcmp(argv[0], "clear")) {
+      clearRules();
+    } else if (0 == strcmp(argv[0], "stats")) {
+      const EdgeRules::Stats& stats = _rules.getStats();
+      _console.printf(" Rules:           %u (%u bytes)\n", _rules.count(), _rules.codeSize());
+      _console.printf(" Updates:         %lu\n", stats.updates);
+      _console.printf(" Evaluated:       %lu\n", stats.evaluated);
+      _console.printf(" Fired:           %lu\n", stats.fired);
+    } else {
+      _console.getStream().println(F("Available commands: list, add <rule>, clear, stats"));
+    }
+  });
+#endif
+
+#if defined(CONFIG_TRACE)
+  _console.addCommand("trace", [this](int argc, const char** argv) {
+    if (argc < 1 || 0 == strcmp(argv[0], "info")) {
+      _console.printf(" Tracing:         %s\n", EdgentTrace::isEnabled() ? "on" : "off");
+      _console.printf(" Events:          %u of %u\n", EdgentTrace::size(), TRACE_RING_SIZE);
+    } else if (0 == strcmp(argv[0], "dump")) {
+      // Save as .json and open in chrome://tracing or ui.perfetto.dev
+      JsonStreamWriter writer(_console.getStream());
+      EdgentTrace::write(writer);
+      _console.print("\n");
+    } else if (0 == strcmp(argv[0], "start")) {
+      EdgentTrace::setEnabled(true);
+    } else if (0 == strcmp(argv[0], "stop")) {
+      EdgentTrace::setEnabled(false);
+    } else if (0 == strcmp(argv[0], "clear")) {
+      EdgentTrace::clear();
+    } else {
+      _console.getStream().println(F("Available commands: info, dump, start, stop, clear"));
+    }
+  });
+#endif
+
+#if defined(CONFIG_PROFILER)
+  _console.addCommand("prof", [this](int argc, const char** argv) {
+    if (argc < 1 || 0 == strcmp(argv[0], "info")) {
+      const EdgentProfiler::Stats stats = EdgentProfiler::getStats();
+      if (!EdgentProfiler::isSupported()) {
+        _console.print(" Profiler:        not supported\n");
+        return;
+      }
+      if (stats.rate) {
+        _console.printf(" Profiler:        on, %lu Hz\n", stats.rate);
+      } else {
+        _console.print(" Profiler:        off\n");
+      }
+      _console.printf(" Samples:         %lu\n", stats.samples);
+      _console.printf(" Dropped:         %lu\n", stats.dropped);
+    } else if (0 == strcmp(argv[0], "start")) {
+      const uint32_t hz = (argc > 1) ? atol(argv[1]) : PROFILER_DEFAULT_RATE;
+      if (!EdgentProfiler::start(hz)) {
+        _console.print(R"json({"status":"error"})json" "\n");
+      }
+    } else if (0 == strcmp(argv[0], "stop")) {
+      EdgentProfiler::stop();
+    } else if (0 == strcmp(argv[0], "clear")) {
+      EdgentProfiler::clear();
+    } else if (0 == strcmp(argv[0], "dump")) {
+      // Symbolize with tools/profile_symbolize.py
+      EdgentProfiler::print(_console.getStream());
+    } else {
+      _console.getStream().println(F("Available commands: info, start [hz], stop, clear, dump"));
+    }
+  });
+#endif
+
 #if defined(CONFIG_COMMAND_SYS)
   _console.addCommand("sys", [this](const BlynkParam &param) {
     const String tool = param[0].asStr();
     if (tool == "info") {
       _console.printf(" Uptime:          %s\n",        timeSpanToStr(systemUptime() / 1000).c_str());
+      if (_time.isValid()) {
+        static const char* sourceStr[] = { "none", "rtc", "particle", "blynk" };
+        _console.printf(" UTC time:        %lu (%s, drift %d ppm)\n",
+                                uint32_t(_time.now() / 1000),
+                                sourceStr[_time.getSource()],
+                                int(_time.getDrift()));
+      }
       _console.printf(" Reset reason:    %s\n",        systemGetResetReason().c_str());
       _console.printf(" Reboots total:   %lu\n",       systemStats.resetCount.total);
       _console.printf("      graceful:   %lu\n",       systemStats.resetCount.graceful);
+      for (unsigned i = 0; i < SYSTEM_RESET_REASON_SLOTS; i++) {
+        if (systemStats.resetReasons[i].count) {
+          _console.printf("   %5u x %s\n", systemStats.resetReasons[i].count,
+                                systemGetResetReason(systemStats.resetReasons[i].code).c_str());
+        }
+      }
       _console.printf(" Network drops:   %d\n",        systemStats.network_drops);
       _console.printf(" Cloud drops:     %d\n",        systemStats.cloud_drops);
       _console.printf(" Online total:    %s\n",        timeSpanToStr(systemStats.total_online_time).c_str());
       _console.printf("          max:    %s\n",        timeSpanToStr(systemStats.max_online_time).c_str());
       _console.printf(" Offline total:   %s\n",        timeSpanToStr(systemStats.total_offline_time).c_str());
       _console.printf("           max:   %s\n",        timeSpanToStr(systemStats.max_offline_time).c_str());
+      const auto& lat = systemStats.latency;
+      _console.printf(" Time to net:     %lu / %lu / %lu ms (p50/p95/p99)\n",
+                                lat.time_to_net.percentile(50),
+                                lat.time_to_net.percentile(95),
+                                lat.time_to_net.percentile(99));
+      _console.printf(" Time to cloud:   %lu / %lu / %lu ms\n",
+                                lat.time_to_cloud.percentile(50),
+                                lat.time_to_cloud.percentile(95),
+                                lat.time_to_cloud.percentile(99));
+      _console.printf(" Online session:  %s / %s / %s\n",
+                                timeSpanToStr(lat.online_session.percentile(50)).c_str(),
+                                timeSpanToStr(lat.online_session.percentile(95)).c_str(),
+                                timeSpanToStr(lat.online_session.percentile(99)).c_str());
+      _console.printf(" Offline gap:     %s / %s / %s\n",
+                                timeSpanToStr(lat.offline_gap.percentile(50)).c_str(),
+                                timeSpanToStr(lat.offline_gap.percentile(95)).c_str(),
+                                timeSpanToStr(lat.offline_gap.percentile(99)).c_str());
+      _console.printf(" Cellular data:   %lu bytes today, %lu this month (%s)\n",
+                                DataUsage::total(_usage.getDaily(), DataUsage::IF_CELLULAR),
+                                DataUsage::total(_usage.getMonthly(), DataUsage::IF_CELLULAR),
+                                DataUsage::getLevelName(_usage.getLevel()));
+      const LinkMonitor::Stats& link = getLinkStats();
+      _console.printf(" Cloud RTT:       %lu ms (var %lu, min %lu, max %lu), %lu of %lu lost\n",
+                                link.srtt, link.rttvar, link.minRtt, link.maxRtt,
+                                link.lost, link.probes);
+      _console.printf("                  %lu / %lu / %lu ms (p50/p95/p99)\n",
+                                lat.cloud_rtt.percentile(50),
+                                lat.cloud_rtt.percentile(95),
+                                lat.cloud_rtt.percentile(99));
+      if (link.commands) {
+        _console.printf(" Command latency: %lu ms avg, %lu max, %lu commands (+/-1 s)\n",
+                                  link.avgCommand, link.maxCommand, link.commands);
+        _console.printf("                  %lu / %lu / %lu ms\n",
+                                  lat.command.percentile(50),
+                                  lat.command.percentile(95),
+                                  lat.command.percentile(99));
+      }
+      if (link.estimated) {
+        _console.printf(" Command (est.):  ~%lu ms, %lu commands without the issue time\n",
+                                  link.estCommand, link.estimated);
+      }
+      _console.printf(" Loop stalls:     %lu (max %lu ms)\n",
+                                systemStats.loop.stalls,
+                                systemStats.loop.max_stall);
+      _console.printf(" Telemetry:       %lu queued, %lu dropped, %lu flushed\n",
+                                systemStats.telemetry.queued,
+                                systemStats.telemetry.dropped,
+                                systemStats.telemetry.flushed);
+      _console.printf(" Coalesced:       %lu messages, %lu bytes\n",
+                                systemStats.telemetry.coalesced,
+                                systemStats.telemetry.coalesced_bytes);
+      _console.printf(" Filtered:        %lu messages\n",
+                                systemStats.telemetry.filtered);
+      _console.printf(" Sampling:        %lu samples, %lu uploads, %lu values\n",
+                                _sampler.getStats().samples,
+                                _sampler.getStats().uploads,
+                                _sampler.getStats().values);
+      _console.printf(" Shadow:          %lu skipped, %lu suppressed, %lu resynced\n",
+                                systemStats.shadow.skipped,
+                                systemStats.shadow.suppressed,
+                                systemStats.shadow.resynced);
+      const Outbox::Stats& outbox = _outbox.getStats();
+      _console.printf(" Outbox:          %u queued (max %lu), %lu deferred, %lu dropped\n",
+                                _outbox.size(), outbox.maxDepth,
+                                outbox.deferred, outbox.dropped);
+      _console.printf(" Outbox wait:     %lu ms avg, %lu ms max\n",
+                                outbox.sent ? outbox.totalWait / outbox.sent : 0,
+                                outbox.maxWait);
+#if defined(CONFIG_COMPRESSION)
+      _console.printf(" Compression:     %lu messages, %lu -> %lu bytes\n",
+                                systemStats.compression.messages,
+                                systemStats.compression.bytes_in,
+                                systemStats.compression.bytes_out);
+#endif
+#if defined(CONFIG_TELEMETRY_JOURNAL)
+      _console.printf(" Journal:         %lu pending, %lu dropped\n",
+                                _journal.size(),
+                                _journal.getStats().dropped);
+#endif
+    } else if (tool == "shadow") {
+      for (unsigned i = 0; i < _shadow.size(); i++) {
+        const PinShadow::Entry& e = _shadow.at(i);
+        _console.printf(" V%-3d v%-5u %s %s\n", e.pin, e.version,
+                                e.dirty ? "*" : " ", e.value);
+      }
+    } else if (tool == "loop") {
+      const LoopMonitor::Stats& loop = _loop.getStats();
+      _console.printf(" Passes:          %lu, max %lu ms\n", loop.passes, loop.maxPass);
+      _console.printf(" Overruns:        %lu (%lu stalls)\n", loop.overruns, loop.stalls);
+      for (unsigned i = 0; i < MODE_MAX_VALUE; i++) {
+        const LoopMonitor::StateStats& st = _loop.getStateStats(i);
+        _console.printf(" %-16s %5lu ms budget, %lu overruns, max %lu ms\n",
+                                getStateName(State(i)).c_str(), st.budget, st.overruns, st.maxPass);
+      }
+      for (unsigned i = 0; i < LoopMonitor::SEG_COUNT; i++) {
+        const LoopMonitor::SegmentStats& seg = _loop.getSegmentStats(i);
+        _console.printf(" %-16s %lu overruns, max %lu ms\n",
+                                LoopMonitor::getSegmentName(i), seg.overruns, seg.maxTime);
+      }
+    } else if (tool == "mem") {
+      const MemoryMonitor::Heap heap = MemoryMonitor::readHeap();
+      const MemoryMonitor::Stats& mem = _memory.getStats();
+      _console.printf(" Heap free:       %lu (min %lu)\n", heap.free, mem.minFree);
+      _console.printf(" Largest block:   %lu (min %lu)\n", heap.largest, mem.minLargest);
+      _console.printf(" Heap total:      %lu\n",          heap.total);
+      MemoryMonitor::ThreadStack stacks[MEM_MAX_THREADS];
+      const unsigned count = MemoryMonitor::readStacks(stacks, MEM_MAX_THREADS);
+      for (unsigned i = 0; i < count; i++) {
+        _console.printf(" Stack %-10s %lu used of %lu\n",
+                                  stacks[i].name ? stacks[i].name : "?",
+                                  stacks[i].used, stacks[i].size);
+      }
+#if defined(CONFIG_MEM_ACCOUNTING)
+      for (unsigned i = 0; i < MemoryMonitor::MEM_COUNT; i++) {
+        const MemoryMonitor::SubsystemStats& st = MemoryMonitor::subsystems[i];
+        _console.printf(" %-8s         %lu alloc, %lu free, %ld bytes\n",
+                                MemoryMonitor::getSubsystemName(i),
+                                st.allocs, st.frees, st.heapDelta);
+      }
+#endif
+    } else if (tool == "crash") {
+      if (param[1].isValid() && String(param[1].asStr()) == "clear") {
+        systemClearCoreDump();
+      } else if (systemHasCoreDump()) {
+        systemPrintCoreDump(_console.getStream());
+      } else {
+        _console.print(" No crash record\n");
+      }
+    } else if (tool == "latency") {
+      JsonStreamWriter writer(_console.getStream());
+      writeLatencyStats(writer);
+      _console.print("\n");
+    } else if (tool == "usage") {
+      if (param[1].isValid() && String(param[1].asStr()) == "clear") {
+        _usage.clear();
+        _store.storeUsage(_usage.data(), _usage.size());
+        applyUsageLevel();
+        return;
+      }
+      const DataUsage::Table& daily = _usage.getDaily();
+      const DataUsage::Table& monthly = _usage.getMonthly();
+      _console.print("             today tx/rx          month tx/rx\n");
+      for (unsigned i = 0; i < DataUsage::IF_COUNT; i++) {
+        if (!DataUsage::total(monthly, i)) continue;
+        _console.printf(" %s:\n", DataUsage::getInterfaceName(i));
+        for (unsigned c = 0; c < DataUsage::USAGE_CLASS_COUNT; c++) {
+          _console.printf("  %-10s %9lu %9lu  %9lu %9lu\n", DataUsage::getClassName(c),
+                                daily[i][c].tx, daily[i][c].rx,
+                                monthly[i][c].tx, monthly[i][c].rx);
+        }
+      }
+      _console.printf(" Budget:          %lu / %lu bytes (day/month), %lu%% used\n",
+                                _usage.getDailyBudget(), _usage.getMonthlyBudget(),
+                                _usage.getBudgetUsed());
+      _console.printf(" Governor:        %s (x%lu)\n",
+                                DataUsage::getLevelName(_usage.getLevel()),
+                                _usage.getScale());
+    } else if (tool == "snapshot") {
+      if (param[1].isValid() && String(param[1].asStr()) == "send") {
+        _console.print(sendDiagSnapshot() ? R"json({"status":"ok"})json" "\n"
+                                          : R"json({"status":"error"})json" "\n");
+      } else {
+        JsonStreamWriter writer(_console.getStream());
+        writeDiagSnapshot(writer);
+        _console.print("\n");
+      }
     } else if (tool == "drop_stats") {
       systemStats.clear();
+      statsCheckpoint();
     } else {
-      _console.getStream().println(F("Available commands: info, drop_stats"));
+      _console.getStream().println(F("Available commands: info, mem, loop, crash [clear], shadow, latency, usage [clear], snapshot [send], drop_stats"));
     }
   });
 #endif // CONFIG_COMMAND_SYS
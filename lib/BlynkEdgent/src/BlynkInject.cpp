@@ -6,6 +6,7 @@
 
 #include "BlynkInject.h"
 #include "BlynkSysUtils.h"
+#include "EdgentTrace.h"
 #include <JsonWriter.h>
 
 LOG_DEFINE_MODULE("blynk.inject")
@@ -59,6 +60,7 @@ void BlynkInject::run() {
 }
 
 void BlynkInject::parse_message() {
+    EDGENT_TRACE_SCOPE("BlynkInject::parse_message");
     if (!_ble.available()) return;
 
     String cmd = _ble.read();
@@ -241,6 +243,40 @@ void BlynkInject::parse_message() {
     }
 }
 
+void BlynkInject::reportProgress(const char* stage)
+{
+    if (!_started) return;
+    LOG_I_MOD("Connecting: %s", stage);
+
+    char buff[64];
+    JsonBufferWriter writer(buff, sizeof(buff));
+    writer.beginObject();
+      writer["t"     ] = "progress";
+      writer["stage" ] = stage;
+    writer.endObject();
+    sendMsg(writer.buffer(), writer.dataSize());
+}
+
+void BlynkInject::reportResult()
+{
+    if (!_started) return;
+
+    if (_last_error == ERROR_NONE) {
+        LOG_I_MOD("Connection verified");
+        sendMsg(R"json({"t":"connect_ok"})json");
+        return;
+    }
+
+    LOG_W_MOD("Connection failed: %d", (int)_last_error);
+    char buff[64];
+    JsonBufferWriter writer(buff, sizeof(buff));
+    writer.beginObject();
+      writer["t"     ] = "connect_fail";
+      writer["err"   ] = (int)_last_error;
+    writer.endObject();
+    sendMsg(writer.buffer(), writer.dataSize());
+}
+
 void BlynkInject::setProvisionCallback(provisionCb_t* cb) {
     provisionCb = cb;
 }
@@ -50,6 +50,10 @@ public:
     void setProvisionCallback(provisionCb_t* cb);
     void setLastError(InjectError err) { _last_error = err; }
 
+    // Progress of the connection attempt, while BLE session is kept open
+    void reportProgress(const char* stage);
+    void reportResult();
+
     struct Config {
         String    intf, ssid, pass, auth, host;
         String    ip, mask, gw, dns, dns2;
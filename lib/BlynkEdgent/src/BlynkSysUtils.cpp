@@ -33,9 +33,16 @@
   #include "dct.h"
 #endif
 
+#if defined(PARTICLE) && (PLATFORM_GEN < 3)
+STARTUP(System.enableFeature(FEATURE_RETAINED_MEMORY));
+#endif
+
 BLYNK_NOINIT_ATTR
 SystemStats systemStats;
 
+BLYNK_NOINIT_ATTR
+CrashRecord systemCrash;
+
 static String sysDevPrefix = "Unknown", sysDevName = "Device";
 
 void systemInit(String devPrefix, String devName)
@@ -258,8 +265,11 @@ void systemReboot()
   #include "rom/rtc.h"
 #endif
 
-String systemGetResetReason() {
-  int reason = rtc_get_reset_reason(0);
+int systemGetResetCode() {
+  return rtc_get_reset_reason(0);
+}
+
+String systemGetResetReason(int reason) {
   switch (reason) {
     case  1: return "POWERON_RESET"; break;          /**<1,  Vbat power on reset*/
     case  3: return "SW_RESET"; break;               /**<3,  Software reset digital core*/
@@ -282,14 +292,30 @@ String systemGetResetReason() {
 
 #elif defined(ESP8266)
 
-String systemGetResetReason() {
-  return ESP.getResetReason();
+int systemGetResetCode() {
+  return ESP.getResetInfoPtr()->reason;
+}
+
+String systemGetResetReason(int reason) {
+  switch (reason) {
+    case REASON_DEFAULT_RST:      return "Power On";
+    case REASON_WDT_RST:          return "Hardware Watchdog";
+    case REASON_EXCEPTION_RST:    return "Exception";
+    case REASON_SOFT_WDT_RST:     return "Software Watchdog";
+    case REASON_SOFT_RESTART:     return "Software/System restart";
+    case REASON_DEEP_SLEEP_AWAKE: return "Deep-Sleep Wake";
+    case REASON_EXT_SYS_RST:      return "External System";
+    default:                      return "Unknown";
+  }
 }
 
 #elif defined(PARTICLE)
 
-String systemGetResetReason() {
-  int reason = System.resetReason();
+int systemGetResetCode() {
+  return System.resetReason();
+}
+
+String systemGetResetReason(int reason) {
   switch (reason) {
     // Hardware
     case RESET_REASON_PIN_RESET:        return "Reset button";
@@ -314,12 +340,20 @@ String systemGetResetReason() {
 
 #else
 
-String systemGetResetReason() {
+int systemGetResetCode() {
+  return 0;
+}
+
+String systemGetResetReason(int reason) {
   return "<unknown>";
 }
 
 #endif
 
+String systemGetResetReason() {
+  return systemGetResetReason(systemGetResetCode());
+}
+
 
 /***************************************************
  * systemGetDeviceUID()
@@ -426,3 +460,126 @@ String systemGetFlashMode() {
 }
 
 #endif
+
+/***************************************************
+ * systemHasCoreDump()
+ ***************************************************/
+
+#if defined(PARTICLE)
+
+static bool isCrashReset(int code) {
+  return code == RESET_REASON_PANIC || code == RESET_REASON_WATCHDOG;
+}
+
+static uint32_t getResetData() {
+  return System.resetReasonData();
+}
+
+static const char* getPanicName(int code, uint32_t data) {
+  if (code != RESET_REASON_PANIC) return "";
+  static const char* names[] = {
+    "", "HardFault", "NMIFault", "MemManage", "BusFault", "UsageFault",
+    "InvalidLength", "Exit", "OutOfHeap", "SPIOverRun", "AssertionFailure",
+    "InvalidCase", "PureVirtualCall", "StackOverflow", "HeapError", "SecureFault"
+  };
+  return (data < sizeof(names)/sizeof(names[0])) ? names[data] : "";
+}
+
+#else
+
+static bool isCrashReset(int code) {
+  return false;
+}
+
+static uint32_t getResetData() {
+  return 0;
+}
+
+static const char* getPanicName(int code, uint32_t data) {
+  return "";
+}
+
+#endif
+
+static uint32_t getBuildId() {
+  static const char build[] = __DATE__ " " __TIME__;
+  return BlynkCRC32(build, sizeof(build));
+}
+
+void CrashRecord::begin() {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  const bool valid = (_magic == 0x5EC0DE01) && (_build == getBuildId());
+#pragma GCC diagnostic pop
+  if (!valid) {
+    memset((void*)this, 0, sizeof(CrashRecord));
+    _magic = 0x5EC0DE01;
+    _build = getBuildId();
+    return;
+  }
+  const int code = systemGetResetCode();
+  if (isCrashReset(code)) {
+    dump = context;
+    resetCode = code;
+    resetData = getResetData();
+    hasDump = true;
+    reported = false;
+  }
+  memset(&context, 0, sizeof(context));
+}
+
+size_t CrashRecord::describe(char* buff, size_t size) const {
+  const char* panic = getPanicName(resetCode, resetData);
+  int len = snprintf(buff, size, "%s%s%s in %s/%s after %lus, loop %lu/%lu ms, heap %lu",
+                     systemGetResetReason(resetCode).c_str(),
+                     *panic ? ": " : "", panic,
+                     dump.state[0] ? dump.state : "?",
+                     dump.segment[0] ? dump.segment : "?",
+                     (unsigned long)dump.passStart / 1000, (unsigned long)dump.lastPass,
+                     (unsigned long)dump.maxPass, (unsigned long)dump.minHeap);
+  for (unsigned i = 0; i < CRASH_TRACE_EVENTS && dump.trace[i][0]; i++) {
+    if (len < 0 || size_t(len) >= size) break;
+    len += snprintf(buff + len, size - len, "%s%s", i ? "<" : ", trace ", dump.trace[i]);
+  }
+  return (len < 0) ? 0 : BlynkMin(size_t(len), size - 1);
+}
+
+void CrashRecord::print(Stream& stream) const {
+  char buff[96];
+  const char* panic = getPanicName(resetCode, resetData);
+  snprintf(buff, sizeof(buff), " Reset reason:    %s (%lu) %s\n",
+           systemGetResetReason(resetCode).c_str(), (unsigned long)resetData, panic);
+  stream.print(buff);
+  snprintf(buff, sizeof(buff), " State:           %s / %s\n",
+           dump.state[0] ? dump.state : "?", dump.segment[0] ? dump.segment : "?");
+  stream.print(buff);
+  snprintf(buff, sizeof(buff), " Loop started:    %s after boot\n",
+           timeSpanToStr(dump.passStart / 1000).c_str());
+  stream.print(buff);
+  snprintf(buff, sizeof(buff), " Last loop:       %lu ms (max %lu ms)\n",
+           (unsigned long)dump.lastPass, (unsigned long)dump.maxPass);
+  stream.print(buff);
+  snprintf(buff, sizeof(buff), " Min free heap:   %lu\n", (unsigned long)dump.minHeap);
+  stream.print(buff);
+  for (unsigned i = 0; i < CRASH_TRACE_EVENTS && dump.trace[i][0]; i++) {
+    snprintf(buff, sizeof(buff), " Trace -%u:        %s\n", i, dump.trace[i]);
+    stream.print(buff);
+  }
+  snprintf(buff, sizeof(buff), " Reported:        %s\n", reported ? "yes" : "no");
+  stream.print(buff);
+}
+
+bool systemHasCoreDump() {
+  return systemCrash.hasDump;
+}
+
+void systemPrintCoreDump(Stream& stream) {
+  if (systemCrash.hasDump) {
+    systemCrash.print(stream);
+  }
+}
+
+void systemClearCoreDump() {
+  systemCrash.clear();
+}
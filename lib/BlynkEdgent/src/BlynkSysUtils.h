@@ -28,7 +28,7 @@
   #define BLYNK_NOINIT_ATTR     __NOINIT_ATTR
   //#define BLYNK_NOINIT_ATTR   RTC_NOINIT_ATTR
 #elif defined(PARTICLE)
-  #define BLYNK_NOINIT_ATTR     // Not supported
+  #define BLYNK_NOINIT_ATTR     retained
 #else
   #define BLYNK_NOINIT_ATTR     __attribute__((section(".noinit")))
 #endif
@@ -41,11 +41,58 @@ String    systemGetDeviceUID();
 uint64_t  systemUptime();
 void      systemReboot();
 String    systemGetResetReason();
+String    systemGetResetReason(int code);
+int       systemGetResetCode();
 String    systemGetFlashMode();
 bool      systemHasCoreDump();
 void      systemPrintCoreDump(Stream& stream);
 void      systemClearCoreDump();
 
+#define SYSTEM_RESET_REASON_SLOTS   8
+#define LOG_HISTOGRAM_BUCKETS       20
+
+// Log-scale histogram: bucket i counts values in [2^i, 2^(i+1)),
+// the first one also counts 0, the last one everything above
+struct LogHistogram {
+  uint16_t buckets[LOG_HISTOGRAM_BUCKETS];
+
+  void add(uint32_t value) {
+    unsigned i = 0;
+    while (value > 1 && i < LOG_HISTOGRAM_BUCKETS - 1) {
+      value >>= 1;
+      i++;
+    }
+    if (buckets[i] < 0xFFFF) {
+      buckets[i]++;
+    }
+  }
+
+  uint32_t count() const {
+    uint32_t n = 0;
+    for (unsigned i = 0; i < LOG_HISTOGRAM_BUCKETS; i++) {
+      n += buckets[i];
+    }
+    return n;
+  }
+
+  // Estimated, interpolated within the bucket
+  uint32_t percentile(unsigned p) const {
+    const uint32_t n = count();
+    if (!n) return 0;
+    const uint32_t rank = (n * p + 99) / 100;
+    uint32_t seen = 0;
+    for (unsigned i = 0; i < LOG_HISTOGRAM_BUCKETS; i++) {
+      if (seen + buckets[i] >= rank) {
+        const uint32_t lo = i ? (1UL << i) : 0;
+        const uint32_t hi = 1UL << (i + 1);
+        return lo + uint64_t(hi - lo) * (rank - seen) / buckets[i];
+      }
+      seen += buckets[i];
+    }
+    return 0;
+  }
+};
+
 class SystemStats {
 public:
   struct {
@@ -53,6 +100,12 @@ public:
     uint32_t graceful;
   } resetCount;
 
+  // Reset reason histogram, see systemGetResetReason(code)
+  struct {
+    int16_t  code;
+    uint16_t count;
+  } resetReasons[SYSTEM_RESET_REASON_SLOTS];
+
   uint32_t cloud_drops;
   uint32_t network_drops;
   uint32_t max_online_time;
@@ -60,17 +113,53 @@ public:
   uint32_t total_online_time;
   uint32_t total_offline_time;
 
+  struct {
+    uint32_t queued;
+    uint32_t dropped;
+    uint32_t flushed;
+    uint32_t coalesced;
+    uint32_t coalesced_bytes;
+    uint32_t filtered;
+  } telemetry;
+
+  struct {
+    uint32_t skipped;
+    uint32_t suppressed;
+    uint32_t resynced;
+  } shadow;
+
+  struct {
+    uint32_t messages;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+  } compression;
+
+  struct {
+    LogHistogram time_to_net;       // ms
+    LogHistogram time_to_cloud;     // ms
+    LogHistogram online_session;    // s
+    LogHistogram offline_gap;       // s
+    LogHistogram cloud_rtt;         // ms
+    LogHistogram command;           // ms, +/-1 s, see Edgent::commandReceived
+  } latency;
+
+  struct {
+    uint32_t stalls;
+    uint32_t max_stall;             // ms
+  } loop;
+
 public:
   SystemStats() {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wuninitialized"
 #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
-    if (_magic != expectedMagic()) {
+    _coldStart = (_magic != expectedMagic());
+    if (_coldStart) {
       clear();
-    } else {
-      resetCount.total++;
     }
 #pragma GCC diagnostic pop
+    // Uptime starts over
+    _last_connected_change = 0;
   }
 
   void clear() {
@@ -78,12 +167,58 @@ public:
     _magic = expectedMagic();
   }
 
+  // The stats were lost (i.e. power loss), and may be restored from a checkpoint
+  bool isColdStart() const {
+    return _coldStart;
+  }
+
+  // Checkpoint is a raw copy, accepted only with the same layout
+  const void* data() const      { return this; }
+  size_t      size() const      { return sizeof(SystemStats); }
+
+  bool restore(const void* data, size_t len) {
+    if (len != sizeof(SystemStats)) {
+      return false;
+    }
+    memcpy((void*)this, data, len);
+    if (_magic != expectedMagic()) {
+      clear();
+      return false;
+    }
+    _coldStart = false;
+    _last_connected_change = 0;
+    return true;
+  }
+
+  void trackReset(int code) {
+    resetCount.total++;
+    unsigned slot = 0;
+    for (unsigned i = 0; i < SYSTEM_RESET_REASON_SLOTS; i++) {
+      if (resetReasons[i].count && resetReasons[i].code == code) {
+        slot = i;
+        break;
+      }
+      // Otherwise, take a free or the least used slot
+      if (resetReasons[i].count < resetReasons[slot].count) {
+        slot = i;
+      }
+    }
+    if (resetReasons[slot].code != code) {
+      resetReasons[slot].code = code;
+      resetReasons[slot].count = 0;
+    }
+    if (resetReasons[slot].count < 0xFFFF) {
+      resetReasons[slot].count++;
+    }
+  }
+
 public:
   void trackConnected() {
     const uint64_t now = systemUptime();
     const uint32_t delta_secs = (now - _last_connected_change) / 1000;
     total_offline_time += delta_secs;
     max_offline_time = max(max_offline_time, delta_secs);
+    latency.offline_gap.add(delta_secs);
     _last_connected_change = now;
   }
 
@@ -92,11 +227,13 @@ public:
     const uint32_t delta_secs = (now - _last_connected_change) / 1000;
     total_online_time += delta_secs;
     max_online_time = max(max_online_time, delta_secs);
+    latency.online_session.add(delta_secs);
     _last_connected_change = now;
   }
 
 private:
   uint64_t _last_connected_change;
+  bool     _coldStart;
 
 private:
   static uint32_t expectedMagic() {
@@ -108,3 +245,55 @@ private:
 
 extern SystemStats systemStats;
 
+#define CRASH_TRACE_EVENTS          6
+#define CRASH_NAME_SIZE             16
+
+/*
+ * Post-mortem record, kept in retained RAM.
+ * The context is updated while running, and copied to the dump
+ * if the device was reset by a panic or the watchdog.
+ * Names are copied (and cut to CRASH_NAME_SIZE), as pointers
+ * into the image would be stale after a rebuild.
+ */
+class CrashRecord {
+public:
+  struct Context {
+    char        state[CRASH_NAME_SIZE];     // Edgent state
+    char        segment[CRASH_NAME_SIZE];   // Main loop segment in progress
+    uint32_t    passStart;      // ms of uptime
+    uint32_t    lastPass;       // ms
+    uint32_t    maxPass;        // ms
+    uint32_t    minHeap;
+    char        trace[CRASH_TRACE_EVENTS][CRASH_NAME_SIZE];  // The last trace events, the newest first
+  };
+
+  static void setName(char* dst, const char* name) {
+    strncpy(dst, name ? name : "", CRASH_NAME_SIZE - 1);
+    dst[CRASH_NAME_SIZE - 1] = '\0';
+  }
+
+  Context   context;
+  Context   dump;
+  int32_t   resetCode;
+  uint32_t  resetData;          // i.e. panic code
+  bool      hasDump;
+  bool      reported;           // Sent to the cloud
+
+  // Call once on boot
+  void begin();
+
+  void clear() {
+    hasDump = false;
+  }
+
+  // Compact, for an event description
+  size_t describe(char* buff, size_t size) const;
+  void   print(Stream& stream) const;
+
+private:
+  uint32_t  _build;
+  uint32_t  _magic;
+};
+
+extern CrashRecord systemCrash;
+
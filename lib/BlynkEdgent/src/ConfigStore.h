@@ -5,6 +5,7 @@
  */
 
 #include <Preferences.h>
+#include <EdgentTrace.h>
 
 #define BLYNK_PREFS_NAMESPACE "blynk"
 
@@ -22,6 +23,16 @@ struct ConfigStore {
   const String& getFirmwareVer() const  {  return _fwver;   }
   const String& getBlynkAuth() const    {  return _auth;    }
   const String& getBlynkHost() const    {  return _host;    }
+  // Cached address is valid only for the host it was resolved for
+  String        getHostAddr(const String& host) const {
+    return (host == _hostname) ? _hostaddr : String();
+  }
+  uint32_t      getHostAddrExpiry() const { return _hostexp; }
+  const String& getServerHost() const   {  return _srvhost; }
+  const String& getServerRTT() const    {  return _srvrtt;  }
+  uint32_t      getServerProbeTime() const { return _srvtime; }
+  const String& getRules() const        {  return _rules;   }
+  float         getTimeDrift() const    {  return _timedrift; }
 
   bool isConfigured() const {
     return (_auth.length() == 32) && isSaved();
@@ -51,6 +62,69 @@ struct ConfigStore {
     }
   }
 
+  // Selected regional server, measured RTTs ("host:ms host:ms ...")
+  // and the UTC time (s) of the probe, 0 if unknown
+  void storeServerHost(const String& host, const String& rtt, uint32_t time) {
+    _srvhost = host;
+    _srvrtt = rtt;
+    _srvtime = time;
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE)) {
+      prefs.putString("srvhost", _srvhost);
+      prefs.putString("srvrtt",  _srvrtt);
+      prefs.putString("srvtime", String(_srvtime));
+    }
+  }
+
+  // Compiled edge rules, hex-encoded
+  void storeRules(const String& rules) {
+    _rules = rules;
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE)) {
+      prefs.putString("rules", _rules);
+    }
+  }
+
+  // Estimated clock drift, ppm
+  void storeTimeDrift(float drift) {
+    _timedrift = drift;
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE)) {
+      prefs.putString("timedrift", String(_timedrift, 2));
+    }
+  }
+
+  // SystemStats checkpoint, survives power loss
+  void storeStats(const void* data, size_t len) {
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE)) {
+      prefs.putBytes("stats", data, len);
+    }
+  }
+
+  size_t loadStats(void* data, size_t len) {
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE, true)) { // read-only
+      return prefs.getBytes("stats", data, len);
+    }
+    return 0;
+  }
+
+  void storeUsage(const void* data, size_t len) {
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE)) {
+      prefs.putBytes("usage", data, len);
+    }
+  }
+
+  size_t loadUsage(void* data, size_t len) {
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE, true)) { // read-only
+      return prefs.getBytes("usage", data, len);
+    }
+    return 0;
+  }
+
   void setBlynkAuth(const String& auth) {
     _auth = auth;
     _saved = false;
@@ -61,15 +135,37 @@ struct ConfigStore {
     _saved = false;
   }
 
+  // Expiry is UTC time (if known), 0 otherwise
+  void storeHostAddr(const String& host, const String& addr, uint32_t expiry) {
+    _hostname = host;
+    _hostaddr = addr;
+    _hostexp = expiry;
+    Preferences prefs;
+    if (prefs.begin(BLYNK_PREFS_NAMESPACE)) {
+      prefs.putString("hostname", _hostname);
+      prefs.putString("hostaddr", _hostaddr);
+      prefs.putString("hostexp",  String(_hostexp));
+    }
+  }
+
   void loadDefault() {
     _saved = false;
     _cfgskip = 0;
     _fwver = BLYNK_FIRMWARE_VERSION;
     _auth = "invalid token";
     _host = BLYNK_DEFAULT_SERVER;
+    _hostname = "";
+    _hostaddr = "";
+    _hostexp = 0;
+    _srvhost = "";
+    _srvrtt = "";
+    _srvtime = 0;
+    _rules = "";
+    _timedrift = 0;
   }
 
   void commit() {
+    EDGENT_TRACE_SCOPE("ConfigStore::commit");
     Preferences prefs;
     if (prefs.begin(BLYNK_PREFS_NAMESPACE)) {
       prefs.putString("auth",  _auth);
@@ -87,6 +183,16 @@ struct ConfigStore {
         prefs.remove("cfgskip");
         prefs.remove("auth");
         prefs.remove("host");
+        prefs.remove("hostname");
+        prefs.remove("hostaddr");
+        prefs.remove("hostexp");
+        prefs.remove("srvhost");
+        prefs.remove("srvrtt");
+        prefs.remove("srvtime");
+        prefs.remove("rules");
+        prefs.remove("timedrift");
+        prefs.remove("stats");
+        prefs.remove("usage");
       }
       loadDefault();
     } else {
@@ -105,6 +211,14 @@ private:
       _fwver = prefs.getString("fwver");
       _auth  = prefs.getString("auth",  _auth);
       _host  = prefs.getString("host",  _host);
+      _hostname = prefs.getString("hostname", _hostname);
+      _hostaddr = prefs.getString("hostaddr", _hostaddr);
+      _hostexp = strtoul(prefs.getString("hostexp", "0").c_str(), NULL, 10);
+      _srvhost = prefs.getString("srvhost", _srvhost);
+      _srvrtt  = prefs.getString("srvrtt",  _srvrtt);
+      _srvtime = strtoul(prefs.getString("srvtime", "0").c_str(), NULL, 10);
+      _rules   = prefs.getString("rules",   _rules);
+      _timedrift = prefs.getString("timedrift", "0").toFloat();
       _saved = (_auth.length() == 32);
       return _saved;
     }
@@ -119,4 +233,12 @@ private:
   String        _fwver;
   String        _auth;
   String        _host;
+  String        _hostname;
+  String        _hostaddr;
+  uint32_t      _hostexp;
+  String        _srvhost;
+  String        _srvrtt;
+  uint32_t      _srvtime;
+  String        _rules;
+  float         _timedrift;
 };
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentLink_h
+#define EdgentLink_h
+
+/*
+ * Cloud link round-trip time, measured with the server time requests
+ * (sent in place of the heartbeat ping), and smoothed the same way
+ * as TCP SRTT (RFC 6298).
+ * Command latency is the time from the moment a write was issued
+ * to the moment it is handled on the device. It is measured only for
+ * the commands that carry the issue time, the rest get an estimate,
+ * which is kept apart from the measured figures.
+ * Distributions (measured only) are kept in systemStats.latency.
+ */
+class LinkMonitor {
+
+public:
+
+  struct Stats {
+    uint32_t    probes;
+    uint32_t    lost;         // No reply within RTT_PROBE_TIMEOUT
+    uint32_t    srtt;         // ms, smoothed
+    uint32_t    rttvar;       // ms
+    uint32_t    lastRtt;      // ms
+    uint32_t    minRtt;       // ms
+    uint32_t    maxRtt;       // ms
+    uint32_t    commands;     // With the issue time
+    uint32_t    avgCommand;   // ms, smoothed
+    uint32_t    maxCommand;   // ms
+    uint32_t    estimated;    // Without the issue time
+    uint32_t    estCommand;   // ms, estimate of the latest one
+  };
+
+  void probeSent(uint32_t now) {
+    if (_pending) {
+      _stats.lost++;
+    }
+    _stats.probes++;
+    _pending = true;
+    _probeTime = now;
+  }
+
+  // Returns false if the reply was not expected
+  bool probeReceived(uint32_t now) {
+    if (!_pending) {
+      return false;
+    }
+    _pending = false;
+    const uint32_t rtt = now - _probeTime;
+    if (!_stats.srtt) {
+      _stats.srtt = rtt;
+      _stats.rttvar = rtt / 2;
+      _stats.minRtt = rtt;
+    } else {
+      const uint32_t err = (rtt > _stats.srtt) ? rtt - _stats.srtt : _stats.srtt - rtt;
+      _stats.rttvar = (3 * _stats.rttvar + err) / 4;
+      _stats.srtt = (7 * _stats.srtt + rtt) / 8;
+      _stats.minRtt = BlynkMin(_stats.minRtt, rtt);
+    }
+    _stats.lastRtt = rtt;
+    _stats.maxRtt = BlynkMax(_stats.maxRtt, rtt);
+    systemStats.latency.cloud_rtt.add(rtt);
+    return true;
+  }
+
+  void check(uint32_t now) {
+    if (_pending && now - _probeTime > RTT_PROBE_TIMEOUT) {
+      _pending = false;
+      _stats.lost++;
+    }
+  }
+
+  // The reply will not come over a new connection
+  void reset() {
+    _pending = false;
+  }
+
+  void commandReceived(uint32_t latency) {
+    _stats.avgCommand = _stats.commands ? (7 * _stats.avgCommand + latency) / 8 : latency;
+    _stats.maxCommand = BlynkMax(_stats.maxCommand, latency);
+    _stats.commands++;
+    systemStats.latency.command.add(latency);
+  }
+
+  void commandEstimated(uint32_t latency) {
+    _stats.estCommand = latency;
+    _stats.estimated++;
+  }
+
+  const Stats& getStats() const { return _stats; }
+
+private:
+  Stats         _stats = {};
+  uint32_t      _probeTime = 0;
+  bool          _pending = false;
+};
+
+#endif /* EdgentLink_h */
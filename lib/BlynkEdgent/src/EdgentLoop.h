@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentLoop_h
+#define EdgentLoop_h
+
+/*
+ * Measures every main loop pass, split into segments.
+ * Passes over the budget of the current state are counted,
+ * and attributed to the segment that took the most time.
+ */
+class LoopMonitor {
+
+public:
+
+  enum Segment {
+    SEG_TIMER,
+    SEG_CONSOLE,
+    SEG_NETMGR,
+    SEG_INJECT,
+    SEG_STATE,
+    SEG_COUNT
+  };
+
+  enum Result {
+    WITHIN_BUDGET,
+    OVERRUN,
+    STALL           // Over LOOP_STALL_THRESHOLD
+  };
+
+  static const unsigned MAX_STATES = 8;
+
+  struct Stats {
+    uint32_t    passes;
+    uint32_t    overruns;
+    uint32_t    stalls;
+    uint32_t    maxPass;      // ms
+  };
+
+  struct StateStats {
+    uint32_t    budget;       // ms
+    uint32_t    overruns;
+    uint32_t    maxPass;      // ms
+  };
+
+  struct SegmentStats {
+    uint32_t    overruns;     // Blamed on this segment
+    uint32_t    maxTime;      // ms
+  };
+
+  // Context of the last overrun
+  struct Overrun {
+    unsigned    state;
+    Segment     segment;
+    uint32_t    duration;     // ms
+    uint32_t    segmentTime;  // ms
+  };
+
+  static const char* getSegmentName(unsigned s) {
+    static const char* names[SEG_COUNT] = {
+      "timers", "console", "netmgr", "inject", "state"
+    };
+    return (s < SEG_COUNT) ? names[s] : "";
+  }
+
+  LoopMonitor() {
+    for (unsigned i = 0; i < MAX_STATES; i++) {
+      _states[i].budget = LOOP_BUDGET;
+    }
+  }
+
+  void setBudget(unsigned state, uint32_t ms) {
+    if (state < MAX_STATES) {
+      _states[state].budget = ms;
+    }
+  }
+
+  // The context is also kept in systemCrash, to see where it hangs
+  void begin() {
+    _passStart = _segStart = micros();
+    memset(_segTime, 0, sizeof(_segTime));
+    systemCrash.context.passStart = millis();
+    CrashRecord::setName(systemCrash.context.segment, getSegmentName(SEG_TIMER));
+  }
+
+  // Closes the segment, started by begin() or the previous mark()
+  void mark(Segment s) {
+    const uint32_t now = micros();
+    _segTime[s] += now - _segStart;
+    _segStart = now;
+    // After the last segment, it's the application loop()
+    CrashRecord::setName(systemCrash.context.segment,
+                         (s + 1 < SEG_COUNT) ? getSegmentName(s + 1) : "app");
+  }
+
+  Result end(unsigned state) {
+    mark(SEG_STATE);
+    const uint32_t duration = (_segStart - _passStart) / 1000;
+    _stats.passes++;
+    _stats.maxPass = BlynkMax(_stats.maxPass, duration);
+    systemCrash.context.lastPass = duration;
+    systemCrash.context.maxPass = _stats.maxPass;
+    for (unsigned i = 0; i < SEG_COUNT; i++) {
+      _segments[i].maxTime = BlynkMax(_segments[i].maxTime, _segTime[i] / 1000);
+    }
+    if (state >= MAX_STATES) {
+      return WITHIN_BUDGET;
+    }
+    StateStats& st = _states[state];
+    st.maxPass = BlynkMax(st.maxPass, duration);
+    if (duration <= st.budget) {
+      return WITHIN_BUDGET;
+    }
+
+    unsigned worst = 0;
+    for (unsigned i = 1; i < SEG_COUNT; i++) {
+      if (_segTime[i] > _segTime[worst]) worst = i;
+    }
+    _stats.overruns++;
+    st.overruns++;
+    _segments[worst].overruns++;
+    _lastOverrun.state = state;
+    _lastOverrun.segment = Segment(worst);
+    _lastOverrun.duration = duration;
+    _lastOverrun.segmentTime = _segTime[worst] / 1000;
+
+    if (duration >= LOOP_STALL_THRESHOLD) {
+      _stats.stalls++;
+      return STALL;
+    }
+    return OVERRUN;
+  }
+
+  const Stats&        getStats() const                { return _stats; }
+  const StateStats&   getStateStats(unsigned s) const { return _states[s]; }
+  const SegmentStats& getSegmentStats(unsigned s) const { return _segments[s]; }
+  const Overrun&      getLastOverrun() const          { return _lastOverrun; }
+
+private:
+  uint32_t      _passStart = 0;
+  uint32_t      _segStart = 0;
+  uint32_t      _segTime[SEG_COUNT] = {};   // us
+
+  Stats         _stats = {};
+  StateStats    _states[MAX_STATES] = {};
+  SegmentStats  _segments[SEG_COUNT] = {};
+  Overrun       _lastOverrun = {};
+};
+
+#endif /* EdgentLoop_h */
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentMemory_h
+#define EdgentMemory_h
+
+/*
+ * Heap and stack usage.
+ * The heap is sampled periodically to keep the minimums.
+ * Stack high-water marks of all threads are read from the RTOS.
+ * With CONFIG_MEM_ACCOUNTING, malloc/calloc/realloc/free (and so operator new,
+ * String etc.) are counted per subsystem running on the application thread
+ * at the moment (see EDGENT_MEM_SCOPE). Allocations made by other threads
+ * are counted as "threads". The firmware must be linked with:
+ *
+ *   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+ */
+class MemoryMonitor {
+
+public:
+
+  enum Subsystem {
+    MEM_OTHER,
+    MEM_CONSOLE,
+    MEM_NETMGR,
+    MEM_INJECT,
+    MEM_CONFIG,
+    MEM_BLYNK,
+    MEM_THREADS,        // Other threads
+    MEM_COUNT
+  };
+
+  struct Heap {
+    uint32_t    free;
+    uint32_t    largest;      // Largest free block
+    uint32_t    total;
+  };
+
+  struct Stats {
+    uint32_t    samples;
+    uint32_t    minFree;
+    uint32_t    minLargest;
+  };
+
+  struct SubsystemStats {
+    uint32_t    allocs;       // malloc, calloc and realloc calls
+    uint32_t    frees;
+    int32_t     heapDelta;    // Net bytes held
+  };
+
+  struct ThreadStack {
+    const char* name;
+    uint32_t    size;         // bytes
+    uint32_t    used;         // bytes, high-water mark
+  };
+
+  static const char* getSubsystemName(unsigned s) {
+    static const char* names[MEM_COUNT] = {
+      "other", "console", "netmgr", "inject", "config", "blynk", "threads"
+    };
+    return (s < MEM_COUNT) ? names[s] : "";
+  }
+
+  static Heap readHeap() {
+    Heap h = {};
+#if defined(PARTICLE)
+    runtime_info_t info = {};
+    info.size = sizeof(info);
+    HAL_Core_Runtime_Info(&info, NULL);
+    h.free    = info.freeheap;
+    h.largest = info.largest_free_block_heap;
+    h.total   = info.total_heap;
+#endif
+    return h;
+  }
+
+  // Call on the application thread
+  void begin() {
+#if defined(PARTICLE)
+    appThread = os_thread_current(NULL);
+#endif
+    sample();
+  }
+
+  void sample() {
+    const Heap h = readHeap();
+    if (!_stats.samples++) {
+      _stats.minFree = h.free;
+      _stats.minLargest = h.largest;
+    } else {
+      _stats.minFree = BlynkMin(_stats.minFree, h.free);
+      _stats.minLargest = BlynkMin(_stats.minLargest, h.largest);
+    }
+  }
+
+  const Stats& getStats() const { return _stats; }
+
+  // Stacks of all threads (or of one), returns the number filled in
+  static unsigned readStacks(ThreadStack* out, unsigned max, bool appOnly = false) {
+    struct Ctx {
+      ThreadStack*  out;
+      unsigned      max;
+      unsigned      count;
+    } ctx = { out, max, 0 };
+#if defined(PARTICLE)
+    os_thread_dump(appOnly ? appThread : OS_THREAD_INVALID_HANDLE,
+      [](os_thread_dump_info_t* info, void* ptr) -> os_result_t {
+        Ctx* c = (Ctx*)ptr;
+        if (c->count < c->max) {
+          ThreadStack& t = c->out[c->count++];
+          t.name = info->name;
+          t.size = info->stack_size;
+          t.used = info->stack_size - info->stack_high_watermark;
+        }
+        return 0;
+      }, &ctx);
+#endif
+    return ctx.count;
+  }
+
+  // Application thread stack high-water mark, in bytes
+  static ThreadStack getAppStack() {
+    ThreadStack t = {};
+    readStacks(&t, 1, true);
+    return t;
+  }
+
+  // Owner of an allocation made right now.
+  // Scopes are set on the application thread only
+  static Subsystem owner() {
+#if defined(PARTICLE)
+    if (appThread && os_thread_current(NULL) != appThread) {
+      return MEM_THREADS;
+    }
+#endif
+    return current;
+  }
+
+  static Subsystem       current;
+  static SubsystemStats  subsystems[MEM_COUNT];   // Updated atomically
+#if defined(PARTICLE)
+  static os_thread_t     appThread;
+#endif
+
+private:
+  Stats                 _stats = {};
+};
+
+#if defined(CONFIG_MEM_ACCOUNTING)
+
+// Only switches the owner, the heap is not read here
+class MemoryScope {
+public:
+  explicit MemoryScope(MemoryMonitor::Subsystem s)
+    : _prev(MemoryMonitor::current)
+  {
+    MemoryMonitor::current = s;
+  }
+
+  ~MemoryScope() {
+    MemoryMonitor::current = _prev;
+  }
+
+private:
+  MemoryMonitor::Subsystem  _prev;
+};
+
+#define EDGENT_MEM_SCOPE(s)   MemoryScope _memScope(MemoryMonitor::s)
+
+#else
+
+#define EDGENT_MEM_SCOPE(s)
+
+#endif
+
+#endif /* EdgentMemory_h */
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentOutbox_h
+#define EdgentOutbox_h
+
+/*
+ * Rate-limited outgoing message scheduler.
+ * Messages are sent in order of priority, then age,
+ * as long as the token bucket allows.
+ */
+class Outbox {
+
+public:
+
+  enum Priority {
+    PRIO_META,
+    PRIO_TELEMETRY,
+    PRIO_CONTROL,
+    PRIO_EVENT
+  };
+
+  struct Stats {
+    uint32_t    sent;         // Messages sent from the queue
+    uint32_t    deferred;
+    uint32_t    dropped;
+    uint32_t    maxDepth;
+    uint32_t    maxWait;      // ms
+    uint32_t    totalWait;    // ms
+  };
+
+  // Largest number of tokens taken at once (timestamped telemetry replay)
+  static constexpr uint32_t MAX_COST = 3;
+
+  // Rate of 0 disables the limit.
+  // Burst is raised to MAX_COST, or such messages would never be sent
+  void setRate(uint32_t rate, uint32_t burst) {
+    _rate  = rate;
+    _burst = BlynkMax(burst, MAX_COST);
+    _credit = BlynkMin(_credit, _burst * 1000);
+  }
+
+  unsigned size() const   { return _count; }
+  bool isEmpty() const    { return _count == 0; }
+  const Stats& getStats() const { return _stats; }
+
+  // Takes tokens for sending right away.
+  // Fails if over budget, or if messages of the same or higher priority are waiting
+  bool acquire(Priority prio, unsigned n = 1) {
+    refill();
+    if (_credit < n * 1000 || hasPending(prio)) {
+      return false;
+    }
+    _credit -= n * 1000;
+    return true;
+  }
+
+  // Returns false if the message was dropped
+  bool push(Priority prio, uint8_t cmd, const void* data, size_t len) {
+    if (len > OUTBOX_MSG_SIZE) {
+      _stats.dropped++;
+      return false;
+    }
+
+    Message* msg = NULL;
+    if (_count < OUTBOX_SLOTS) {
+      for (unsigned i = 0; i < OUTBOX_SLOTS; i++) {
+        if (!_msgs[i].used) { msg = &_msgs[i]; break; }
+      }
+      _count++;
+    } else {
+      // Evict the oldest message of the lowest priority
+      msg = select(false);
+      if (msg->prio >= prio) {
+        _stats.dropped++;
+        return false;
+      }
+      _stats.dropped++;
+    }
+
+    msg->used = true;
+    msg->prio = prio;
+    msg->cmd  = cmd;
+    msg->len  = len;
+    msg->seq  = _seq++;
+    msg->time = millis();
+    memcpy(msg->data, data, len);
+
+    _stats.deferred++;
+    _stats.maxDepth = BlynkMax<uint32_t>(_stats.maxDepth, _count);
+    return true;
+  }
+
+  // Sends waiting messages that fit the budget
+  template <typename F>
+  void run(F send) {
+    refill();
+    while (_count && _credit >= 1000) {
+      Message* msg = select(true);
+      send(msg->cmd, msg->data, msg->len);
+      _credit -= 1000;
+
+      const uint32_t wait = millis() - msg->time;
+      _stats.sent++;
+      _stats.totalWait += wait;
+      _stats.maxWait = BlynkMax(_stats.maxWait, wait);
+
+      msg->used = false;
+      _count--;
+    }
+  }
+
+  void clear() {
+    for (unsigned i = 0; i < OUTBOX_SLOTS; i++) {
+      _msgs[i].used = false;
+    }
+    _count = 0;
+  }
+
+private:
+
+  struct Message {
+    bool        used;
+    uint8_t     prio;
+    uint8_t     cmd;
+    uint8_t     len;
+    uint32_t    seq;
+    uint32_t    time;
+    uint8_t     data[OUTBOX_MSG_SIZE];
+  };
+  static_assert(OUTBOX_MSG_SIZE <= 255, "OUTBOX_MSG_SIZE does not fit Message::len");
+
+  void refill() {
+    const uint32_t now = millis();
+    const uint32_t maxCredit = _burst * 1000;
+    const uint32_t elapsed = now - _lastRefill;
+    _lastRefill = now;
+    if (!_rate || elapsed >= maxCredit / _rate) {
+      _credit = maxCredit;
+    } else {
+      _credit = BlynkMin(_credit + elapsed * _rate, maxCredit);
+    }
+  }
+
+  bool hasPending(Priority prio) const {
+    for (unsigned i = 0; i < OUTBOX_SLOTS; i++) {
+      if (_msgs[i].used && _msgs[i].prio >= prio) return true;
+    }
+    return false;
+  }
+
+  // Oldest message of the highest (or lowest) priority
+  Message* select(bool highest) {
+    Message* best = NULL;
+    for (unsigned i = 0; i < OUTBOX_SLOTS; i++) {
+      Message* msg = &_msgs[i];
+      if (!msg->used) continue;
+      if (!best || (highest ? msg->prio > best->prio : msg->prio < best->prio) ||
+          (msg->prio == best->prio && int32_t(msg->seq - best->seq) < 0))
+      {
+        best = msg;
+      }
+    }
+    return best;
+  }
+
+  Message       _msgs[OUTBOX_SLOTS] = {};
+  unsigned      _count = 0;
+  uint32_t      _seq = 0;
+
+  uint32_t      _rate  = BLYNK_MSG_RATE;
+  uint32_t      _burst = BLYNK_MSG_BURST;
+  uint32_t      _credit = BLYNK_MSG_BURST * 1000;  // 1/1000 of a message
+  uint32_t      _lastRefill = 0;
+  Stats         _stats = {};
+};
+
+#endif /* EdgentOutbox_h */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "EdgentProfiler.h"
+
+#if defined(CONFIG_PROFILER)
+
+#include <Arduino.h>
+#include <stdio.h>
+
+static_assert((PROFILER_SLOTS & (PROFILER_SLOTS - 1)) == 0, "PROFILER_SLOTS must be a power of 2");
+
+namespace EdgentProfiler {
+
+// Open addressing, with a short probe sequence to bound the time spent in the ISR
+struct Histogram {
+  uint32_t    keys[PROFILER_SLOTS];     // (addr >> PROFILER_BUCKET_SHIFT) + 1, 0 is empty
+  uint16_t    counts[PROFILER_SLOTS];
+
+  bool add(uint32_t addr) {
+    const uint32_t key = (addr >> PROFILER_BUCKET_SHIFT) + 1;
+    uint32_t idx = (key * 2654435761u) >> 16;
+    for (unsigned i = 0; i < PROFILER_MAX_PROBES; i++, idx++) {
+      idx &= PROFILER_SLOTS - 1;
+      if (keys[idx] == key) {
+        if (counts[idx] < 0xFFFF) counts[idx]++;
+        return true;
+      } else if (!keys[idx]) {
+        keys[idx] = key;
+        counts[idx] = 1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void clear() {
+    memset(keys, 0, sizeof(keys));
+    memset(counts, 0, sizeof(counts));
+  }
+
+  void print(Print& out, const char* kind) const {
+    char buff[32];
+    for (unsigned i = 0; i < PROFILER_SLOTS; i++) {
+      if (!keys[i]) continue;
+      snprintf(buff, sizeof(buff), "%s 0x%08lx %u\n", kind,
+               (unsigned long)((keys[i] - 1) << PROFILER_BUCKET_SHIFT), counts[i]);
+      out.print(buff);
+    }
+  }
+};
+
+static Histogram          pcHist;
+static Histogram          lrHist;
+static volatile uint32_t  samples = 0;
+static volatile uint32_t  dropped = 0;
+static volatile uint32_t  rate = 0;
+static volatile bool      paused = false;
+
+// Called from the timer interrupt
+static void sample(uint32_t pc, uint32_t lr) {
+  if (paused) return;
+  samples++;
+  if (!pcHist.add(pc)) dropped++;
+  // LR is a return address (Thumb bit set), or EXC_RETURN in a handler
+  if (lr < 0xF0000000) {
+    lrHist.add(lr & ~1UL);
+  }
+}
+
+#if defined(PARTICLE) && (PLATFORM_GEN == 3)
+
+#define PROF_CONCAT_(a, b)  a##b
+#define PROF_CONCAT(a, b)   PROF_CONCAT_(a, b)
+#define PROF_TIMER_REG      PROF_CONCAT(NRF_TIMER, PROFILER_NRF_TIMER)
+#define PROF_TIMER_IRQn     PROF_CONCAT(PROF_CONCAT(TIMER, PROFILER_NRF_TIMER), _IRQn)
+
+extern "C" void edgent_profiler_frame(const uint32_t* frame) {
+  PROF_TIMER_REG->EVENTS_COMPARE[0] = 0;
+  (void)PROF_TIMER_REG->EVENTS_COMPARE[0];    // Flush the write before returning
+  // Exception frame: r0, r1, r2, r3, r12, lr, pc, xpsr
+  sample(frame[6], frame[5]);
+}
+
+// Picks the stack that holds the exception frame, using EXC_RETURN
+extern "C" __attribute__((naked)) void edgent_profiler_isr() {
+  __asm volatile(
+    "tst   lr, #4                 \n"
+    "ite   eq                     \n"
+    "mrseq r0, msp                \n"
+    "mrsne r0, psp                \n"
+    "b     edgent_profiler_frame  \n"
+  );
+}
+
+bool isSupported() {
+  return true;
+}
+
+static bool startTimer(uint32_t hz) {
+  if (!attachInterruptDirect(PROF_TIMER_IRQn, edgent_profiler_isr)) {
+    return false;
+  }
+  NVIC_SetPriority(PROF_TIMER_IRQn, PROFILER_IRQ_PRIORITY);
+  PROF_TIMER_REG->TASKS_STOP   = 1;
+  PROF_TIMER_REG->TASKS_CLEAR  = 1;
+  PROF_TIMER_REG->MODE         = TIMER_MODE_MODE_Timer;
+  PROF_TIMER_REG->BITMODE      = TIMER_BITMODE_BITMODE_32Bit;
+  PROF_TIMER_REG->PRESCALER    = 4;             // 1 MHz
+  PROF_TIMER_REG->CC[0]        = 1000000 / hz;
+  PROF_TIMER_REG->SHORTS       = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+  PROF_TIMER_REG->EVENTS_COMPARE[0] = 0;
+  PROF_TIMER_REG->INTENSET     = TIMER_INTENSET_COMPARE0_Msk;
+  PROF_TIMER_REG->TASKS_START  = 1;
+  return true;
+}
+
+static void stopTimer() {
+  PROF_TIMER_REG->TASKS_STOP   = 1;
+  PROF_TIMER_REG->INTENCLR     = TIMER_INTENCLR_COMPARE0_Msk;
+  detachInterruptDirect(PROF_TIMER_IRQn);
+}
+
+#else
+
+bool isSupported() {
+  return false;
+}
+
+static bool startTimer(uint32_t) {
+  return false;
+}
+
+static void stopTimer() {
+}
+
+#endif
+
+bool isRunning() {
+  return rate != 0;
+}
+
+bool start(uint32_t hz) {
+  if (!hz || hz > PROFILER_MAX_RATE) {
+    return false;
+  }
+  stop();
+  clear();
+  if (!startTimer(hz)) {
+    return false;
+  }
+  rate = hz;
+  return true;
+}
+
+void stop() {
+  if (isRunning()) {
+    stopTimer();
+    rate = 0;
+  }
+}
+
+void clear() {
+  paused = true;
+  pcHist.clear();
+  lrHist.clear();
+  samples = 0;
+  dropped = 0;
+  paused = false;
+}
+
+Stats getStats() {
+  Stats s;
+  s.samples = samples;
+  s.dropped = dropped;
+  s.rate = rate;
+  return s;
+}
+
+void print(Print& out) {
+  paused = true;
+  char buff[80];
+  snprintf(buff, sizeof(buff), "# profile samples=%lu dropped=%lu shift=%d\n",
+           (unsigned long)samples, (unsigned long)dropped, PROFILER_BUCKET_SHIFT);
+  out.print(buff);
+  pcHist.print(out, "pc");
+  lrHist.print(out, "lr");
+  paused = false;
+}
+
+}
+
+#endif
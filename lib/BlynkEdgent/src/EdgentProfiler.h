@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentProfiler_h
+#define EdgentProfiler_h
+
+#include <EdgentSettings.h>
+
+/*
+ * Statistical profiler.
+ * A hardware timer interrupt samples the interrupted PC and LR
+ * into two fixed histograms, keyed by address range (PROFILER_BUCKET_SHIFT).
+ * Any thread can be interrupted, so this is a whole-system profile.
+ *
+ * The dump contains raw addresses only:
+ *
+ *   prof dump > profile.txt
+ *   tools/profile_symbolize.py profile.txt --elf target/firmware.elf
+ *
+ * Compiled out unless CONFIG_PROFILER is defined.
+ * Currently supported on Gen3 devices (nRF52840) only.
+ */
+
+#if defined(CONFIG_PROFILER)
+
+#include <stdint.h>
+
+class Print;
+
+namespace EdgentProfiler {
+
+  struct Stats {
+    uint32_t    samples;
+    uint32_t    dropped;      // Histogram is full
+    uint32_t    rate;         // Hz
+  };
+
+  bool     isSupported();
+  bool     isRunning();
+
+  // Clears the histograms and starts sampling
+  bool     start(uint32_t hz = PROFILER_DEFAULT_RATE);
+  void     stop();
+  void     clear();
+
+  Stats    getStats();
+
+  // "pc 0x<addr> <count>" and "lr 0x<addr> <count>" lines
+  void     print(Print& out);
+
+}
+
+#endif
+
+#endif /* EdgentProfiler_h */
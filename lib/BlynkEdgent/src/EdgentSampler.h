@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentSampler_h
+#define EdgentSampler_h
+
+/*
+ * Fixed-rate sampling with on-device aggregation.
+ * Each channel is sampled into a ring buffer, and only
+ * the aggregates are emitted at the upload interval.
+ * If the upload window has more samples than the ring holds,
+ * the ring gets block averages instead, so it spans the whole window.
+ */
+class Sampler {
+
+public:
+
+  enum Aggregate {
+    AGG_MIN,
+    AGG_MAX,
+    AGG_MEAN,
+    AGG_LAST,
+    AGG_LTTB,         // Downsampled series, emitted with sample timestamps
+    AGG_COUNT
+  };
+
+  typedef float (*read_t)(void);
+
+  struct Stats {
+    uint32_t    samples;
+    uint32_t    uploads;
+    uint32_t    values;       // Values emitted
+  };
+
+  // Returns the channel index, or -1 if no free channels
+  int add(read_t read, uint32_t sampleInterval, uint32_t uploadInterval) {
+    if (_count == SAMPLER_CHANNELS || !read || !sampleInterval) {
+      return -1;
+    }
+    Channel& ch = _channels[_count];
+    memset(&ch, 0, sizeof(Channel));
+    memset(ch.pins, NO_PIN, sizeof(ch.pins));
+    ch.read = read;
+    ch.sampleInterval = sampleInterval;
+    ch.uploadInterval = BlynkMax(uploadInterval, sampleInterval);
+    ch.lastSample = ch.lastUpload = millis();
+    reset(ch);
+    return _count++;
+  }
+
+  bool setOutput(int idx, Aggregate agg, uint8_t pin) {
+    if (idx < 0 || unsigned(idx) >= _count || agg >= AGG_COUNT) {
+      return false;
+    }
+    _channels[idx].pins[agg] = pin;
+    return true;
+  }
+
+  // Upload intervals are multiplied by the scale (see DataUsage)
+  void setUploadScale(uint32_t scale) {
+    _uploadScale = BlynkMax<uint32_t>(scale, 1);
+  }
+
+  bool isEmpty() const    { return _count == 0; }
+  const Stats& getStats() const { return _stats; }
+
+  // emit(pin, value, ts): ts is systemUptime() of the sample, or 0 for aggregates
+  template <typename F>
+  void run(F emit) {
+    const uint32_t now = millis();
+    for (unsigned i = 0; i < _count; i++) {
+      Channel& ch = _channels[i];
+      // Keep the fixed rate, skip samples if late for more than one interval
+      if (now - ch.lastSample >= ch.sampleInterval) {
+        ch.lastSample += ch.sampleInterval;
+        if (now - ch.lastSample >= ch.sampleInterval) {
+          ch.lastSample = now;
+        }
+        sample(ch);
+      }
+      if (now - ch.lastUpload >= ch.uploadInterval * _uploadScale) {
+        ch.lastUpload = now;
+        upload(ch, emit);
+      }
+    }
+  }
+
+private:
+
+  static const uint8_t NO_PIN = 0xFF;
+
+  struct Channel {
+    read_t      read;
+    uint32_t    sampleInterval;
+    uint32_t    uploadInterval;
+    uint32_t    lastSample;
+    uint32_t    lastUpload;
+    uint8_t     pins[AGG_COUNT];
+
+    // Aggregates since the last upload
+    uint32_t    count;
+    float       min, max, sum, last;
+
+    // The latest samples (or block averages), for downsampling
+    float       ring[SAMPLER_RING_SIZE];
+    uint32_t    ringTime[SAMPLER_RING_SIZE];  // millis()
+    unsigned    ringHead;
+    unsigned    ringCount;
+
+    uint32_t    decimate;     // Samples per ring entry
+    uint32_t    blockCount;
+    float       blockSum;
+    uint32_t    blockStart;   // millis()
+  };
+
+  void reset(Channel& ch) {
+    ch.count = 0;
+    ch.sum = 0;
+    ch.min = INFINITY;
+    ch.max = -INFINITY;
+    ch.ringCount = 0;
+    ch.blockCount = 0;
+    ch.blockSum = 0;
+    const uint32_t window = ch.uploadInterval * _uploadScale / ch.sampleInterval;
+    ch.decimate = BlynkMax<uint32_t>((window + SAMPLER_RING_SIZE - 1) / SAMPLER_RING_SIZE, 1);
+  }
+
+  static void push(Channel& ch, float val, uint32_t time) {
+    ch.ring[ch.ringHead] = val;
+    ch.ringTime[ch.ringHead] = time;
+    ch.ringHead = (ch.ringHead + 1) % SAMPLER_RING_SIZE;
+    if (ch.ringCount < SAMPLER_RING_SIZE) {
+      ch.ringCount++;
+    }
+  }
+
+  // Closes the current block, timed at its middle
+  static void closeBlock(Channel& ch) {
+    if (!ch.blockCount) return;
+    push(ch, ch.blockSum / ch.blockCount, ch.blockStart + (millis() - ch.blockStart) / 2);
+    ch.blockCount = 0;
+    ch.blockSum = 0;
+  }
+
+  void sample(Channel& ch) {
+    const float val = ch.read();
+    _stats.samples++;
+    if (isnan(val)) return;
+
+    ch.count++;
+    ch.sum += val;
+    ch.min = BlynkMin(ch.min, val);
+    ch.max = BlynkMax(ch.max, val);
+    ch.last = val;
+
+    if (!ch.blockCount) {
+      ch.blockStart = millis();
+    }
+    ch.blockSum += val;
+    if (++ch.blockCount >= ch.decimate) {
+      closeBlock(ch);
+    }
+  }
+
+  template <typename F>
+  void upload(Channel& ch, F emit) {
+    if (!ch.count) return;
+    _stats.uploads++;
+
+    const float values[] = { ch.min, ch.max, ch.sum / ch.count, ch.last };
+    for (unsigned agg = 0; agg < AGG_LTTB; agg++) {
+      if (ch.pins[agg] != NO_PIN) {
+        emit(ch.pins[agg], values[agg], 0);
+        _stats.values++;
+      }
+    }
+    if (ch.pins[AGG_LTTB] != NO_PIN) {
+      closeBlock(ch);
+      downsample(ch, [&](unsigned i) {
+        const unsigned pos = ringIndex(ch, i);
+        const uint64_t ts = systemUptime() - (millis() - ch.ringTime[pos]);
+        emit(ch.pins[AGG_LTTB], ch.ring[pos], ts);
+        _stats.values++;
+      });
+    }
+    reset(ch);
+  }
+
+  static unsigned ringIndex(const Channel& ch, unsigned i) {
+    return (ch.ringHead + SAMPLER_RING_SIZE - ch.ringCount + i) % SAMPLER_RING_SIZE;
+  }
+
+  // Largest-Triangle-Three-Buckets: keeps the first and the last sample,
+  // and from each bucket in between, the one forming the largest triangle
+  template <typename F>
+  static void downsample(const Channel& ch, F emit) {
+    const unsigned n = ch.ringCount;
+    const unsigned m = SAMPLER_LTTB_POINTS;
+    if (n <= m || m < 3) {
+      for (unsigned i = 0; i < n; i++) emit(i);
+      return;
+    }
+
+    const float bucket = float(n - 2) / (m - 2);
+    unsigned a = 0;
+    emit(a);
+    for (unsigned b = 0; b < m - 2; b++) {
+      // Average of the next bucket
+      const unsigned nextStart = unsigned((b + 1) * bucket) + 1;
+      const unsigned nextEnd   = BlynkMin(unsigned((b + 2) * bucket) + 1, n);
+      float avgX = 0, avgY = 0;
+      for (unsigned j = nextStart; j < nextEnd; j++) {
+        avgX += j;
+        avgY += ch.ring[ringIndex(ch, j)];
+      }
+      avgX /= (nextEnd - nextStart);
+      avgY /= (nextEnd - nextStart);
+
+      const unsigned start = unsigned(b * bucket) + 1;
+      const unsigned end   = unsigned((b + 1) * bucket) + 1;
+      const float ax = a, ay = ch.ring[ringIndex(ch, a)];
+      float maxArea = -1;
+      unsigned best = start;
+      for (unsigned j = start; j < end; j++) {
+        const float area = fabsf((ax - avgX) * (ch.ring[ringIndex(ch, j)] - ay) -
+                                 (ax - j) * (avgY - ay));
+        if (area > maxArea) {
+          maxArea = area;
+          best = j;
+        }
+      }
+      emit(best);
+      a = best;
+    }
+    emit(n - 1);
+  }
+
+  Channel       _channels[SAMPLER_CHANNELS];
+  unsigned      _count = 0;
+  uint32_t      _uploadScale = 1;
+  Stats         _stats = {};
+};
+
+#endif /* EdgentSampler_h */
@@ -4,6 +4,9 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#ifndef EdgentSettings_h
+#define EdgentSettings_h
+
 /*
  * Advanced options
  */
@@ -38,3 +41,133 @@
 #define WIFI_NET_CONNECT_TIMEOUT      50000     // ms
 #define WIFI_CLOUD_CONNECT_TIMEOUT    50000     // ms
 
+// Virtual pin writes are queued while offline, and sent after reconnecting
+#define TELEMETRY_QUEUE_SIZE          64        // records
+#define TELEMETRY_VALUE_SIZE          16        // bytes
+#define TELEMETRY_FLUSH_BATCH         10        // records
+#define TELEMETRY_FLUSH_INTERVAL      100       // ms
+
+// Writes within the window are combined: only the last value per pin is sent
+#define TELEMETRY_COALESCE_WINDOW     0         // ms, 0 to disable
+#define TELEMETRY_COALESCE_SLOTS      16        // pins
+
+// Maximum number of pins with a deadband/change filter
+#define TELEMETRY_FILTER_SLOTS        16
+
+// Maximum number of pins in the local shadow
+#define SHADOW_PIN_SLOTS              16
+
+// Sampling channels, see addSampler()
+#define SAMPLER_CHANNELS              4
+#define SAMPLER_RING_SIZE             60        // points kept for downsampling (block averages)
+#define SAMPLER_LTTB_POINTS           10        // points sent per upload
+#define SAMPLER_TICK_INTERVAL         10        // ms
+
+// Outgoing messages over the rate are deferred, in order of priority
+#define BLYNK_MSG_RATE                50        // messages/s, 0 to disable
+#define BLYNK_MSG_BURST               25        // messages
+#define OUTBOX_SLOTS                  16        // deferred messages
+#define OUTBOX_MSG_SIZE               128       // bytes
+
+// Large payloads sent with virtualWriteCompressed are LZ-compressed (see LzStream.h),
+// once the receiver reports the "lz" capability.
+// BLE provisioning messages are small and always sent as is
+//#define CONFIG_COMPRESSION
+//#define COMPRESSION_PEER_PIN          V102      // The receiver writes its capabilities here
+#define COMPRESSION_BUFFER_SIZE       512       // bytes, reserved in RAM
+#define COMPRESSION_MIN_SIZE          64        // smaller payloads are sent as is
+
+// When the RAM queue is full, the oldest records are moved to flash
+//#define CONFIG_TELEMETRY_JOURNAL
+#define TELEMETRY_JOURNAL_DIR         "/usr/telemetry"
+#define TELEMETRY_JOURNAL_SEGMENT     256       // records per file
+#define TELEMETRY_JOURNAL_SEGMENTS    32        // files
+#define TELEMETRY_JOURNAL_SYNC        16        // records per flash sync
+
+// Local automation rules, set using the "rules" command
+#define CONFIG_EDGE_RULES
+//#define EDGE_RULES_PIN                V100      // Rules can be also written to this pin
+
+// Server time is requested on connect and then periodically.
+// Apps that need the time can use BlynkEdgent.onServerTimeReceived().
+// Comment out if the app defines BLYNK_WRITE(InternalPinRTC) or uses WidgetRTC,
+// then call BlynkEdgent.onServerTime() from the app handler
+#define CONFIG_SERVER_TIME_HANDLER
+#define TIME_SYNC_INTERVAL            (6*3600)  // s
+#define TIME_DRIFT_MIN_SPAN           (24*3600) // s, between syncs used for the drift estimate
+#define TIME_MAX_DRIFT_PPM            500
+#define TIME_SYNC_RESOLUTION          1000      // ms, time sources truncate to the second
+
+// Cloud RTT is measured with the server time requests, sent in place of the heartbeat
+#define RTT_PROBE_INTERVAL            BLYNK_HEARTBEAT // s, 0 to use TIME_SYNC_INTERVAL only
+#define RTT_PROBE_TIMEOUT             10000     // ms
+
+// Heap is sampled for the minimums, stack high-water marks come from the RTOS
+#define MEM_SAMPLE_INTERVAL           1000      // ms
+#define MEM_MAX_THREADS               16        // shown by "sys mem"
+//#define CONFIG_MEM_ACCOUNTING                 // Attribute heap use to subsystems, needs --wrap=malloc etc.
+
+// Main loop passes over the budget are attributed to the state and subsystem
+#define LOOP_BUDGET                   100       // ms
+#define LOOP_BUDGET_CONNECTING        2000      // ms
+#define LOOP_STALL_THRESHOLD          1000      // ms, logged
+
+// Hardware watchdog is fed only while the loop stays within the budget
+//#define CONFIG_HW_WATCHDOG
+#define HW_WATCHDOG_TIMEOUT           30000     // ms
+
+// Scoped tracing of the main loop, dumped as Chrome trace JSON ("trace dump")
+//#define CONFIG_TRACE
+#define TRACE_RING_SIZE               256       // events, power of 2
+
+// Statistical PC/LR sampling profiler ("prof" command), Gen3 only
+//#define CONFIG_PROFILER
+#define PROFILER_DEFAULT_RATE         1000      // Hz
+#define PROFILER_MAX_RATE             10000     // Hz
+#define PROFILER_SLOTS                512       // per histogram, power of 2
+#define PROFILER_MAX_PROBES           8
+#define PROFILER_BUCKET_SHIFT         2         // 4-byte address ranges
+#define PROFILER_NRF_TIMER            4         // TIMER4, must be unused by the app
+#define PROFILER_IRQ_PRIORITY         2
+
+// Fleet health snapshot (SystemStats, link, heap) is sent to this pin
+//#define DIAG_SNAPSHOT_PIN             V101
+#define DIAG_SNAPSHOT_INTERVAL        3600      // s
+#define DIAG_SNAPSHOT_BUFFER_SIZE     1024      // bytes, the worst case is ~750
+
+// Data usage accounting, budgets apply to the cellular interface
+#define USAGE_DAILY_BUDGET            0         // bytes, 0 for no limit
+#define USAGE_MONTHLY_BUDGET          0         // bytes, 0 for no limit
+#define USAGE_SAVE_PERCENT            75        // Stretch uploads, no metadata
+#define USAGE_CRITICAL_PERCENT        90        // No remote terminal
+#define USAGE_SCALE_SAVE              2         // Upload interval factors
+#define USAGE_SCALE_CRITICAL          4
+#define USAGE_SCALE_EXCEEDED          16
+#define USAGE_COALESCE_WINDOW         10000     // ms, coalescing used when governed
+#define USAGE_PACKET_OVERHEAD         40        // bytes, TCP/IPv4 headers
+#define USAGE_CONNECT_BYTES           600       // bytes, TCP handshake, login and device info
+
+// SystemStats are kept in retained RAM, and saved to flash for power loss
+#define STATS_CHECKPOINT_INTERVAL     3600      // s, 0 to disable
+#define RETAINED_SYNC_INTERVAL        60        // s, min between retained RAM syncs (Photon 2, P2)
+
+// Blynk server address is cached and used to connect (not with SSL)
+#define BLYNK_DNS_CACHE_TTL           3600      // s, 0 to disable
+
+// When using the default server, probe these regional servers
+// and connect to the one with the lowest TCP connect time
+//#define BLYNK_SERVER_CANDIDATES       "fra1.blynk.cloud lon1.blynk.cloud ny3.blynk.cloud sgp1.blynk.cloud blr1.blynk.cloud"
+#define BLYNK_SERVER_PROBE_INTERVAL   (7*24*3600) // s
+#define BLYNK_SERVER_PROBE_TIMEOUT    3000      // ms, slower servers are not selected
+#define BLYNK_SERVER_PROBE_STACK      3072      // bytes, worker thread
+
+// Particle Cloud on-demand window (i.e. for OTA updates)
+#define PARTICLE_CLOUD_WINDOW         600       // s
+
+// Estimated Particle Cloud traffic, used only for reporting
+#define PARTICLE_CLOUD_HANDSHAKE_BYTES  5000
+#define PARTICLE_CLOUD_KEEPALIVE_BYTES  122
+#define PARTICLE_CLOUD_KEEPALIVE_SECS   (23*60)
+#define PARTICLE_CLOUD_OTA_BYTES        (256*1024) // per firmware update
+
+#endif /* EdgentSettings_h */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentShadow_h
+#define EdgentShadow_h
+
+/*
+ * Local copy of virtual pin state, used to skip
+ * redundant writes in both directions after a reconnect
+ */
+class PinShadow {
+
+public:
+
+  struct Entry {
+    uint8_t     pin;
+    bool        dirty;        // Local value is not yet known to the server
+    uint16_t    version;      // Incremented on each local change
+    uint32_t    server;       // CRC of the value known to the server
+    char        value[TELEMETRY_VALUE_SIZE];
+  };
+
+  Entry* add(uint8_t pin) {
+    Entry* e = find(pin);
+    if (!e && _count < SHADOW_PIN_SLOTS) {
+      e = &_entries[_count++];
+      memset(e, 0, sizeof(Entry));
+      e->pin = pin;
+    }
+    return e;
+  }
+
+  Entry* find(uint8_t pin) {
+    for (unsigned i = 0; i < _count; i++) {
+      if (_entries[i].pin == pin) return &_entries[i];
+    }
+    return NULL;
+  }
+
+  unsigned size() const          { return _count; }
+  const Entry& at(unsigned i) const { return _entries[i]; }
+
+  // Returns true if the value should be sent now.
+  // While offline, changes are only recorded, to be sent by resync()
+  bool write(Entry& e, const char* value, bool online) {
+    const uint32_t crc = hash(value, strlen(value));
+    if (crc != hash(e.value, strlen(e.value))) {
+      setValue(e, value);
+      e.version++;
+    } else if (!online || !e.dirty) {
+      return false;
+    }
+    if (online) {
+      e.server = crc;
+    }
+    e.dirty = (crc != e.server);
+    return online;
+  }
+
+  // Returns false if the incoming value should be ignored
+  bool receive(Entry& e, const BlynkParam& param) {
+    const uint32_t crc = hash(param.getBuffer(), param.getLength());
+    if (crc == hash(e.value, strlen(e.value)) ||
+        (e.dirty && crc == e.server))   // Stale value, local one is newer
+    {
+      return false;
+    }
+    e.server = crc;
+    e.dirty = false;
+    if (param.getLength() < sizeof(e.value)) {
+      setValue(e, (const char*)param.getBuffer());
+    } else {
+      e.value[0] = '\0';
+    }
+    e.version++;
+    return true;
+  }
+
+  // Emits values changed while offline
+  template <typename F>
+  unsigned resync(F emit) {
+    unsigned count = 0;
+    for (unsigned i = 0; i < _count; i++) {
+      Entry& e = _entries[i];
+      if (!e.dirty) continue;
+      e.server = hash(e.value, strlen(e.value));
+      e.dirty = false;
+      emit(e.pin, e.value);
+      count++;
+    }
+    return count;
+  }
+
+private:
+
+  // Multi-value params are separated with zeros, so hash the whole buffer
+  static uint32_t hash(const void* data, size_t len) {
+    return BlynkCRC32(data, len);
+  }
+
+  static void setValue(Entry& e, const char* value) {
+    strncpy(e.value, value, sizeof(e.value) - 1);
+    e.value[sizeof(e.value) - 1] = '\0';
+  }
+
+  Entry         _entries[SHADOW_PIN_SLOTS];
+  unsigned      _count = 0;
+};
+
+#endif /* EdgentShadow_h */
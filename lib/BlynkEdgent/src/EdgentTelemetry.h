@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentTelemetry_h
+#define EdgentTelemetry_h
+
+struct TelemetryRecord {
+  uint64_t      ts;           // systemUptime() when the value was written
+  uint8_t       pin;
+  char          value[TELEMETRY_VALUE_SIZE];
+};
+
+/*
+ * Fixed-capacity ring of virtual pin writes
+ */
+class TelemetryQueue {
+
+public:
+
+  enum Policy {
+    DROP_OLDEST,
+    DROP_NEWEST
+  };
+
+  void setPolicy(Policy policy) {
+    _policy = policy;
+  }
+
+  bool isEmpty() const    { return _count == 0; }
+  bool isFull() const     { return _count == TELEMETRY_QUEUE_SIZE; }
+  unsigned size() const   { return _count; }
+
+  // Returns false if the record was not stored
+  bool push(uint8_t pin, uint64_t ts, const char* value) {
+    if (isFull()) {
+      if (_policy == DROP_NEWEST) {
+        return false;
+      }
+      pop();
+    }
+    TelemetryRecord& rec = _items[(_head + _count) % TELEMETRY_QUEUE_SIZE];
+    rec.ts = ts;
+    rec.pin = pin;
+    strncpy(rec.value, value, sizeof(rec.value) - 1);
+    rec.value[sizeof(rec.value) - 1] = '\0';
+    _count++;
+    return true;
+  }
+
+  const TelemetryRecord& front() const {
+    return _items[_head];
+  }
+
+  bool contains(uint8_t pin) const {
+    for (unsigned i = 0; i < _count; i++) {
+      if (_items[(_head + i) % TELEMETRY_QUEUE_SIZE].pin == pin) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void pop() {
+    if (!_count) return;
+    _head = (_head + 1) % TELEMETRY_QUEUE_SIZE;
+    _count--;
+  }
+
+  void clear() {
+    _head = _count = 0;
+  }
+
+private:
+  TelemetryRecord _items[TELEMETRY_QUEUE_SIZE];
+  unsigned        _head  = 0;
+  unsigned        _count = 0;
+  Policy          _policy = DROP_OLDEST;
+};
+
+/*
+ * Per-pin deadband and change-detection filters
+ */
+class PinFilters {
+
+public:
+
+  enum Result {
+    SEND,
+    SKIP,
+    DEFER       // Sent later, once the minimum interval elapses
+  };
+
+  struct Filter {
+    uint8_t     pin;
+    bool        percent;      // Deadband is a percentage of the last sent value
+    float       deadband;
+    uint32_t    minInterval;  // ms
+    uint32_t    maxSilence;   // ms, 0 to disable the heartbeat
+
+    bool        hasRef;
+    bool        pending;
+    float       ref;          // Last sent value
+    uint32_t    lastSent;
+    char        value[TELEMETRY_VALUE_SIZE]; // Last sent or pending value
+  };
+
+  bool add(uint8_t pin, float deadband, bool percent,
+           uint32_t minInterval, uint32_t maxSilence)
+  {
+    Filter* f = find(pin);
+    if (!f) {
+      if (_count == TELEMETRY_FILTER_SLOTS) {
+        return false;
+      }
+      f = &_filters[_count++];
+    }
+    memset(f, 0, sizeof(Filter));
+    f->pin         = pin;
+    f->percent     = percent;
+    f->deadband    = fabsf(deadband);
+    f->minInterval = minInterval;
+    f->maxSilence  = maxSilence;
+    return true;
+  }
+
+  void remove(uint8_t pin) {
+    Filter* f = find(pin);
+    if (f) {
+      *f = _filters[--_count];
+    }
+  }
+
+  Filter* find(uint8_t pin) {
+    for (unsigned i = 0; i < _count; i++) {
+      if (_filters[i].pin == pin) return &_filters[i];
+    }
+    return NULL;
+  }
+
+  bool isEmpty() const    { return _count == 0; }
+
+  // Non-numeric values always pass
+  Result check(Filter& f, const char* value, uint32_t now) {
+    char* end;
+    const float val = strtof(value, &end);
+    if (end == value || *end) {
+      return SEND;
+    }
+
+    const uint32_t elapsed = now - f.lastSent;
+    if (f.hasRef) {
+      const float band = f.percent ? fabsf(f.ref) * f.deadband / 100 : f.deadband;
+      const bool changed = fabsf(val - f.ref) > band;
+      if (!changed) {
+        if (f.maxSilence && elapsed >= f.maxSilence) {
+          setSent(f, val, value, now);
+          return SEND;
+        }
+        if (f.pending) {
+          // Back inside the band, the deferred change is dropped.
+          // The value is kept, as the stale one must not go out with a heartbeat
+          setValue(f, value);
+          f.pending = false;
+        }
+        return SKIP;
+      }
+      if (elapsed < f.minInterval) {
+        setValue(f, value);
+        f.pending = true;
+        return DEFER;
+      }
+    }
+    setSent(f, val, value, now);
+    return SEND;
+  }
+
+  // Emits deferred values and heartbeats
+  template <typename F>
+  void poll(uint32_t now, F emit) {
+    for (unsigned i = 0; i < _count; i++) {
+      Filter& f = _filters[i];
+      if (!f.hasRef) continue;
+      const uint32_t elapsed = now - f.lastSent;
+      if ((f.pending && elapsed >= f.minInterval) ||
+          (f.maxSilence && elapsed >= f.maxSilence))
+      {
+        setSent(f, strtof(f.value, NULL), f.value, now);
+        emit(f.pin, f.value);
+      }
+    }
+  }
+
+private:
+
+  static void setValue(Filter& f, const char* value) {
+    strncpy(f.value, value, sizeof(f.value) - 1);
+    f.value[sizeof(f.value) - 1] = '\0';
+  }
+
+  static void setSent(Filter& f, float val, const char* value, uint32_t now) {
+    if (value != f.value) {
+      setValue(f, value);
+    }
+    f.ref      = val;
+    f.hasRef   = true;
+    f.pending  = false;
+    f.lastSent = now;
+  }
+
+  Filter        _filters[TELEMETRY_FILTER_SLOTS];
+  unsigned      _count = 0;
+};
+
+/*
+ * Keeps only the last value per virtual pin, until flushed
+ */
+class WriteCombiner {
+
+public:
+
+  bool isEmpty() const    { return _count == 0; }
+  bool isFull() const     { return _count == TELEMETRY_COALESCE_SLOTS; }
+
+  bool contains(uint8_t pin) const {
+    for (unsigned i = 0; i < _count; i++) {
+      if (_slots[i].pin == pin) return true;
+    }
+    return false;
+  }
+
+  // Returns length of the replaced value, -1 if a new slot was used
+  int put(uint8_t pin, const char* value) {
+    for (unsigned i = 0; i < _count; i++) {
+      if (_slots[i].pin == pin) {
+        const int replaced = strlen(_slots[i].value);
+        setValue(_slots[i], value);
+        return replaced;
+      }
+    }
+    if (isFull()) {
+      return -1;
+    }
+    _slots[_count].pin = pin;
+    setValue(_slots[_count], value);
+    _count++;
+    return -1;
+  }
+
+  // Values are emitted in order of the first write
+  template <typename F>
+  void flush(F emit) {
+    for (unsigned i = 0; i < _count; i++) {
+      emit(_slots[i].pin, _slots[i].value);
+    }
+    _count = 0;
+  }
+
+private:
+  struct Slot {
+    uint8_t     pin;
+    char        value[TELEMETRY_VALUE_SIZE];
+  };
+
+  static void setValue(Slot& slot, const char* value) {
+    strncpy(slot.value, value, sizeof(slot.value) - 1);
+    slot.value[sizeof(slot.value) - 1] = '\0';
+  }
+
+  Slot          _slots[TELEMETRY_COALESCE_SLOTS];
+  unsigned      _count = 0;
+};
+
+#endif /* EdgentTelemetry_h */
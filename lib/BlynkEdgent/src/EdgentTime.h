@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentTime_h
+#define EdgentTime_h
+
+/*
+ * Maps systemUptime() to UTC time.
+ * Keeps the last sync point and the clock drift (estimated between
+ * syncs), so uptime timestamps taken before the sync are also mapped.
+ *
+ * Time sources have 1 s resolution, so the drift estimate has an error
+ * of up to 2 s over the span between the syncs: TIME_DRIFT_MIN_SPAN
+ * of 24 h keeps it within ~23 ppm. Shorter spans are not used.
+ * For the same reason, a sync only moves the mapping if it's off
+ * by more than TIME_SYNC_RESOLUTION.
+ */
+class TimeService {
+
+public:
+
+  enum Source {
+    SOURCE_NONE,
+    SOURCE_RTC,         // Device RTC, valid after a reset
+    SOURCE_PARTICLE,
+    SOURCE_BLYNK
+  };
+
+  // Drift is restored from storage, in ppm
+  void begin(float drift) {
+    if (fabsf(drift) <= TIME_MAX_DRIFT_PPM) {
+      _drift = drift;
+    }
+  }
+
+  bool isValid() const        { return _source != SOURCE_NONE; }
+  Source getSource() const    { return _source; }
+  float getDrift() const      { return _drift; }
+  uint64_t getLastSync() const { return _syncUptime; }
+
+  // Returns true if the drift estimate was updated (and is worth storing)
+  bool sync(uint64_t utc, Source src, uint64_t uptime = systemUptime()) {
+    if (src == SOURCE_RTC) {
+      // Only as a starting point, RTC is not used for drift
+      if (!isValid()) {
+        setAnchor(utc, uptime, src);
+      }
+      return false;
+    }
+
+    bool updated = false;
+    if (!_refUptime) {
+      _refUtc = utc;
+      _refUptime = uptime;
+    } else if (uptime - _refUptime >= TIME_DRIFT_MIN_SPAN * 1000ULL) {
+      // Real time elapsed vs. uptime elapsed
+      const double span = double(uptime - _refUptime);
+      const double ppm = (double(int64_t(utc - _refUtc)) - span) / span * 1e6;
+      if (fabs(ppm) <= TIME_MAX_DRIFT_PPM) {
+        _drift = _hasDrift ? (_drift * 3 + ppm) / 4 : ppm;
+        _hasDrift = updated = true;
+      }
+      _refUtc = utc;
+      _refUptime = uptime;
+    }
+
+    // The source time is truncated: while the prediction falls within
+    // [utc, utc + resolution), the anchor is kept, so now() doesn't step
+    // back and forth. Otherwise it's moved by the least step that fits
+    uint64_t predicted;
+    if (_source != SOURCE_RTC && toUtc(uptime, predicted)) {
+      if (predicted < utc) {
+        setAnchor(utc, uptime, src);
+      } else if (predicted >= utc + TIME_SYNC_RESOLUTION) {
+        setAnchor(utc + TIME_SYNC_RESOLUTION - 1, uptime, src);
+      } else {
+        _source = src;
+      }
+    } else {
+      setAnchor(utc, uptime, src);
+    }
+    return updated;
+  }
+
+  // Works for uptime timestamps taken both before and after the sync
+  bool toUtc(uint64_t uptime, uint64_t& utc) const {
+    if (!isValid()) return false;
+    const int64_t delta = int64_t(uptime - _syncUptime);
+    utc = _syncUtc + delta + int64_t(delta * (double)_drift / 1e6);
+    return true;
+  }
+
+  // UTC time (ms), 0 if unknown
+  uint64_t now() const {
+    uint64_t utc = 0;
+    toUtc(systemUptime(), utc);
+    return utc;
+  }
+
+private:
+
+  void setAnchor(uint64_t utc, uint64_t uptime, Source src) {
+    _syncUtc = utc;
+    _syncUptime = uptime;
+    _source = src;
+  }
+
+  Source        _source = SOURCE_NONE;
+  uint64_t      _syncUtc = 0;
+  uint64_t      _syncUptime = 0;
+  float         _drift = 0;
+  bool          _hasDrift = false;
+
+  // Sync point used for the drift estimate
+  uint64_t      _refUtc = 0;
+  uint64_t      _refUptime = 0;
+};
+
+#endif /* EdgentTime_h */
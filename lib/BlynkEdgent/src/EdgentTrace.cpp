@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "EdgentTrace.h"
+
+#if defined(CONFIG_TRACE)
+
+#include <Arduino.h>
+#include <Blynk/BlynkUtility.h>
+#include <JsonWriter.h>
+
+#if !defined(PARTICLE) && !defined(__ARM_ARCH_7M__) && !defined(__ARM_ARCH_7EM__)
+  #include <time.h>
+#endif
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of 2");
+
+namespace EdgentTrace {
+
+static Event              ring[TRACE_RING_SIZE];
+static volatile uint32_t  head = 0;
+static volatile bool      enabled = true;
+
+#if defined(PARTICLE)
+
+uint32_t ticks() {
+  return System.ticks();
+}
+
+uint32_t ticksPerMicrosecond() {
+  return System.ticksPerMicrosecond();
+}
+
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+#define DWT_CTRL    (*(volatile uint32_t*)0xE0001000)
+#define DWT_CYCCNT  (*(volatile uint32_t*)0xE0001004)
+#define DEMCR       (*(volatile uint32_t*)0xE000EDFC)
+
+uint32_t ticks() {
+  if (!(DWT_CTRL & 1)) {
+    DEMCR |= (1 << 24);   // TRCENA
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= 1;        // CYCCNTENA
+  }
+  return DWT_CYCCNT;
+}
+
+uint32_t ticksPerMicrosecond() {
+  return F_CPU / 1000000;
+}
+
+#else
+
+uint32_t ticks() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t ticksPerMicrosecond() {
+  return 1;
+}
+
+#endif
+
+void record(const char* name, uint32_t start, uint32_t end) {
+  if (!enabled) return;
+  const uint32_t idx = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  Event& e = ring[idx & (TRACE_RING_SIZE - 1)];
+  e.name = name;
+  e.start = start;
+  e.duration = end - start;
+}
+
+void setEnabled(bool value) {
+  enabled = value;
+}
+
+bool isEnabled() {
+  return enabled;
+}
+
+void clear() {
+  head = 0;
+}
+
+unsigned size() {
+  const uint32_t n = head;
+  return BlynkMin<uint32_t>(n, TRACE_RING_SIZE);
+}
+
+void last(const char** names, unsigned count) {
+  const uint32_t end = head;
+  const uint32_t avail = BlynkMin<uint32_t>(end, TRACE_RING_SIZE);
+  for (unsigned i = 0; i < count; i++) {
+    names[i] = (i < avail) ? ring[(end - 1 - i) & (TRACE_RING_SIZE - 1)].name : NULL;
+  }
+}
+
+void write(JsonWriter& writer) {
+  const bool wasEnabled = enabled;
+  enabled = false;
+
+  const uint32_t count = size();
+  const uint32_t first = head - count;
+  const double   scale = ticksPerMicrosecond();
+
+  // The tick counter wraps, so timestamps are accumulated from
+  // the differences (which are assumed to fit into int32)
+  int64_t offset = 0, minOffset = 0;
+  uint32_t prev = count ? ring[first & (TRACE_RING_SIZE - 1)].start : 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const Event& e = ring[(first + i) & (TRACE_RING_SIZE - 1)];
+    offset += int32_t(e.start - prev);
+    prev = e.start;
+    minOffset = BlynkMin(minOffset, offset);
+  }
+
+  writer.beginObject();
+  writer.name("traceEvents");
+  writer.beginArray();
+  offset = -minOffset;
+  prev = count ? ring[first & (TRACE_RING_SIZE - 1)].start : 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const Event& e = ring[(first + i) & (TRACE_RING_SIZE - 1)];
+    offset += int32_t(e.start - prev);
+    prev = e.start;
+    writer.beginObject();
+    writer["name"] = e.name;
+    writer["ph"]   = "X";
+    writer.name("ts").value(offset / scale, 2);
+    writer.name("dur").value(e.duration / scale, 2);
+    writer["pid"]  = 1;
+    writer["tid"]  = 1;
+    writer.endObject();
+  }
+  writer.endArray();
+  writer["displayTimeUnit"] = "ms";
+  writer.endObject();
+
+  enabled = wasEnabled;
+}
+
+}
+
+#endif
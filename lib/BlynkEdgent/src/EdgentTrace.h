@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentTrace_h
+#define EdgentTrace_h
+
+#include <EdgentSettings.h>
+
+/*
+ * Scoped tracing of the hot paths:
+ *
+ *   void foo() {
+ *     EDGENT_TRACE_SCOPE("foo");
+ *     ...
+ *   }
+ *
+ * Each scope is recorded on exit as one complete event into a ring buffer.
+ * Recording is lock-free, and the ring can be dumped as Chrome/Perfetto
+ * trace JSON ("trace dump" command).
+ * Compiled out unless CONFIG_TRACE is defined.
+ */
+
+#if defined(CONFIG_TRACE)
+
+#include <stdint.h>
+
+class JsonWriter;
+
+namespace EdgentTrace {
+
+  struct Event {
+    const char*   name;       // Must be a string literal
+    uint32_t      start;      // ticks
+    uint32_t      duration;   // ticks
+  };
+
+  // DWT cycle counter on Cortex-M, microseconds on host builds
+  uint32_t ticks();
+  uint32_t ticksPerMicrosecond();
+
+  void     record(const char* name, uint32_t start, uint32_t end);
+  void     setEnabled(bool enabled);
+  bool     isEnabled();
+  void     clear();
+  unsigned size();
+
+  // Names of the last events, the newest first. The rest is set to NULL
+  void     last(const char** names, unsigned count);
+
+  // {"traceEvents":[...]} in the order of completion, the oldest first
+  void     write(JsonWriter& writer);
+
+  class Scope {
+  public:
+    explicit Scope(const char* name)
+      : _name(name)
+      , _start(ticks())
+    {}
+
+    ~Scope() {
+      record(_name, _start, ticks());
+    }
+
+  private:
+    const char*   _name;
+    uint32_t      _start;
+  };
+
+}
+
+#define EDGENT_TRACE_CONCAT_(a, b)  a##b
+#define EDGENT_TRACE_CONCAT(a, b)   EDGENT_TRACE_CONCAT_(a, b)
+#define EDGENT_TRACE_SCOPE(name)    EdgentTrace::Scope EDGENT_TRACE_CONCAT(_traceScope, __LINE__)(name)
+
+#else
+
+#define EDGENT_TRACE_SCOPE(name)
+
+#endif
+
+#endif /* EdgentTrace_h */
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgentUsage_h
+#define EdgentUsage_h
+
+/*
+ * Data usage accounting, per network interface and traffic class.
+ * Only the traffic that passes through Edgent is seen: message payloads
+ * are counted as sent, headers, TCP/IP and Particle Cloud traffic are estimated.
+ * Totals of the current day and month are persisted (see ConfigStore::storeUsage).
+ *
+ * The governor maps the budget use of the metered (cellular) interface
+ * to a level, which stretches the upload intervals and turns off optional traffic.
+ */
+class DataUsage {
+
+public:
+
+  enum Class {
+    USAGE_TELEMETRY,
+    USAGE_EVENTS,
+    USAGE_TERMINAL,
+    USAGE_PROTOCOL,     // Headers, heartbeats, login, metadata, TCP/IP
+    USAGE_PARTICLE,     // Particle Cloud handshakes and keep-alives
+    USAGE_CLASS_COUNT
+  };
+
+  enum Interface {
+    IF_WIFI,
+    IF_ETHERNET,
+    IF_CELLULAR,
+    IF_COUNT
+  };
+
+  enum Level {
+    LEVEL_NORMAL,
+    LEVEL_SAVE,         // No metadata and diagnostics, uploads stretched
+    LEVEL_CRITICAL,     // No remote terminal
+    LEVEL_EXCEEDED
+  };
+
+  struct Counter {
+    uint32_t    tx;
+    uint32_t    rx;
+  };
+
+  typedef Counter Table[IF_COUNT][USAGE_CLASS_COUNT];
+
+  // Blynk message header
+  static const uint32_t HEADER_SIZE = 5;
+
+  static const char* getClassName(unsigned c) {
+    static const char* names[USAGE_CLASS_COUNT] = {
+      "telemetry", "events", "terminal", "protocol", "particle"
+    };
+    return (c < USAGE_CLASS_COUNT) ? names[c] : "";
+  }
+
+  static const char* getInterfaceName(unsigned i) {
+    static const char* names[IF_COUNT] = { "wifi", "eth", "cell" };
+    return (i < IF_COUNT) ? names[i] : "";
+  }
+
+  static const char* getLevelName(unsigned l) {
+    static const char* names[] = { "normal", "save", "critical", "exceeded" };
+    return (l <= LEVEL_EXCEEDED) ? names[l] : "";
+  }
+
+  // Takes the name from NetMgr.getConnectedInterface(), keeps the last one if not connected
+  void setInterface(const char* name) {
+    for (unsigned i = 0; i < IF_COUNT; i++) {
+      if (0 == strcmp(name, getInterfaceName(i))) {
+        _iface = Interface(i);
+      }
+    }
+  }
+
+  Interface getInterface() const { return _iface; }
+
+  void add(Class c, uint32_t tx, uint32_t rx = 0) {
+    Counter& d = _rec.daily[_iface][c];
+    Counter& m = _rec.monthly[_iface][c];
+    d.tx += tx; d.rx += rx;
+    m.tx += tx; m.rx += rx;
+  }
+
+  // One outgoing message: the header goes to the protocol overhead,
+  // together with a TCP/IP packet and the ACK for it
+  void addMessage(Class c, uint32_t payload) {
+    add(c, payload);
+    add(USAGE_PROTOCOL, HEADER_SIZE + USAGE_PACKET_OVERHEAD, USAGE_PACKET_OVERHEAD);
+  }
+
+  // One incoming message, the reverse of addMessage
+  void addInbound(Class c, uint32_t payload) {
+    add(c, 0, payload);
+    add(USAGE_PROTOCOL, USAGE_PACKET_OVERHEAD, HEADER_SIZE + USAGE_PACKET_OVERHEAD);
+  }
+
+  // Day number since the epoch. Counts from before the time was known
+  // go to the first known day. Returns true if a new day has started
+  bool rollover(uint32_t day) {
+    if (!day || day == _rec.day) {
+      return false;
+    }
+    if (_rec.day) {
+      memset(_rec.daily, 0, sizeof(_rec.daily));
+      if (monthOf(day) != monthOf(_rec.day)) {
+        memset(_rec.monthly, 0, sizeof(_rec.monthly));
+      }
+    }
+    _rec.day = day;
+    return true;
+  }
+
+  const Table& getDaily() const   { return _rec.daily; }
+  const Table& getMonthly() const { return _rec.monthly; }
+  uint32_t     getDay() const     { return _rec.day; }
+
+  static uint32_t total(const Table& t, unsigned iface) {
+    uint32_t sum = 0;
+    for (unsigned c = 0; c < USAGE_CLASS_COUNT; c++) {
+      sum += t[iface][c].tx + t[iface][c].rx;
+    }
+    return sum;
+  }
+
+  /*
+   * Governor
+   */
+
+  // Bytes of the metered interface, 0 for no limit
+  void setBudget(uint32_t daily, uint32_t monthly) {
+    _dailyBudget = daily;
+    _monthlyBudget = monthly;
+    update();
+  }
+
+  uint32_t getDailyBudget() const   { return _dailyBudget; }
+  uint32_t getMonthlyBudget() const { return _monthlyBudget; }
+
+  // Percentage of the budget used, the higher of daily and monthly
+  uint32_t getBudgetUsed() const {
+    uint32_t pct = 0;
+    if (_dailyBudget) {
+      pct = BlynkMax(pct, uint32_t(uint64_t(total(_rec.daily, IF_CELLULAR)) * 100 / _dailyBudget));
+    }
+    if (_monthlyBudget) {
+      pct = BlynkMax(pct, uint32_t(uint64_t(total(_rec.monthly, IF_CELLULAR)) * 100 / _monthlyBudget));
+    }
+    return pct;
+  }
+
+  // Returns true if the level has changed
+  bool update() {
+    const uint32_t pct = getBudgetUsed();
+    Level level = LEVEL_NORMAL;
+    if      (pct >= 100)                      level = LEVEL_EXCEEDED;
+    else if (pct >= USAGE_CRITICAL_PERCENT)   level = LEVEL_CRITICAL;
+    else if (pct >= USAGE_SAVE_PERCENT)       level = LEVEL_SAVE;
+    if (level == _level) {
+      return false;
+    }
+    _level = level;
+    return true;
+  }
+
+  Level getLevel() const { return _level; }
+
+  // Factor for the upload intervals
+  uint32_t getScale() const {
+    static const uint32_t scale[] = {
+      1, USAGE_SCALE_SAVE, USAGE_SCALE_CRITICAL, USAGE_SCALE_EXCEEDED
+    };
+    return scale[_level];
+  }
+
+  bool allowsMetadata() const { return _level < LEVEL_SAVE; }
+  bool allowsTerminal() const { return _level < LEVEL_CRITICAL; }
+
+  /*
+   * Persistence, accepted only with the same layout
+   */
+
+  const void* data() const { return &_rec; }
+  size_t      size() const { return sizeof(_rec); }
+
+  bool restore(const void* data, size_t len) {
+    Record rec;
+    if (len != sizeof(rec)) {
+      return false;
+    }
+    memcpy(&rec, data, len);
+    if (rec.magic != MAGIC) {
+      return false;
+    }
+    _rec = rec;
+    update();
+    return true;
+  }
+
+  void clear() {
+    const uint32_t day = _rec.day;
+    _rec = Record();
+    _rec.day = day;
+    update();
+  }
+
+private:
+
+  // Year * 12 + month, from the days since 1970-01-01
+  static uint32_t monthOf(uint32_t days) {
+    const uint32_t z   = days + 719468;
+    const uint32_t era = z / 146097;
+    const uint32_t doe = z - era * 146097;
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp  = (5 * doy + 2) / 153;
+    const uint32_t m   = (mp < 10) ? mp + 3 : mp - 9;
+    const uint32_t y   = era * 400 + yoe + (m <= 2);
+    return y * 12 + m - 1;
+  }
+
+  static const uint32_t MAGIC = 0x55534701 + sizeof(Table);
+
+  struct Record {
+    uint32_t    magic   = MAGIC;
+    uint32_t    day     = 0;
+    Table       daily   = {};
+    Table       monthly = {};
+  };
+
+  Record        _rec;
+  Interface     _iface = IF_WIFI;
+  Level         _level = LEVEL_NORMAL;
+  uint32_t      _dailyBudget = USAGE_DAILY_BUDGET;
+  uint32_t      _monthlyBudget = USAGE_MONTHLY_BUDGET;
+};
+
+/*
+ * Counts and gates the remote terminal traffic:
+ *
+ *   MultiSerial.addStream(BlynkEdgent.meterTerminal(VirtualSerial));
+ */
+class UsageStream : public Stream {
+
+public:
+  explicit UsageStream(DataUsage& usage)
+    : _usage(usage)
+  {}
+
+  void setStream(Stream& stream) { _stream = &stream; }
+
+  using Print::write;
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  // Output is discarded (as if written) when the terminal is not allowed
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (!_stream || !_usage.allowsTerminal()) {
+      return size;
+    }
+    const size_t n = _stream->write(buffer, size);
+    _usage.add(DataUsage::USAGE_TERMINAL, n);
+    return n;
+  }
+
+  int available() override { return _stream ? _stream->available() : 0; }
+  int peek() override      { return _stream ? _stream->peek() : -1; }
+  void flush() override    { if (_stream) _stream->flush(); }
+
+  int read() override {
+    const int c = _stream ? _stream->read() : -1;
+    if (c >= 0) {
+      _usage.add(DataUsage::USAGE_TERMINAL, 0, 1);
+    }
+    return c;
+  }
+
+private:
+  DataUsage&    _usage;
+  Stream*       _stream = NULL;
+};
+
+#endif /* EdgentUsage_h */
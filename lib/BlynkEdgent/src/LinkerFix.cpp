@@ -6,7 +6,8 @@ extern "C" {
 __attribute__((weak))
 int _gettimeofday( struct timeval *tv, void *tzvp )
 {
-  tv->tv_sec = 0;
+  // RTC is set by the Edgent time service
+  tv->tv_sec = Time.isValid() ? Time.now() : 0;
   tv->tv_usec = 0;
   return 0;
 }
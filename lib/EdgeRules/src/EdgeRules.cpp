@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "EdgeRules.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+
+#define RULE_STACK_SIZE     8
+#define RULE_MAX_DEPTH      4
+#define RULE_EVENT_LEN      32
+
+static_assert(EDGE_RULES_MAX_PINS <= 32, "Pin dependencies are stored as a 32-bit mask");
+
+/*
+ * Compiler
+ */
+
+namespace {
+
+struct Compiler {
+    const char*  p;
+    uint8_t*     out;
+    size_t       len;
+    size_t       cap;
+    const char*  error;
+
+    void skipSpaces() {
+        while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    }
+
+    bool match(const char* tok) {
+        skipSpaces();
+        const size_t n = strlen(tok);
+        if (strncmp(p, tok, n)) return false;
+        // Keywords must not be followed by identifier chars
+        if (isalpha((unsigned char)tok[0]) && (isalnum((unsigned char)p[n]) || p[n] == '_')) {
+            return false;
+        }
+        p += n;
+        return true;
+    }
+
+    bool fail(const char* msg) {
+        if (!error) error = msg;
+        return false;
+    }
+
+    bool emit(uint8_t b) {
+        if (len >= cap) return fail("rules too long");
+        out[len++] = b;
+        return true;
+    }
+
+    bool parsePin(uint8_t& pin) {
+        skipSpaces();
+        if ((*p != 'V' && *p != 'v') || !isdigit((unsigned char)p[1])) return false;
+        char* end;
+        const long val = strtol(p + 1, &end, 10);
+        if (val < 0 || val > 255) return fail("invalid pin");
+        pin = val;
+        p = end;
+        return true;
+    }
+
+    bool parseOperand() {
+        uint8_t pin;
+        if (parsePin(pin)) {
+            return emit(EdgeRules::OP_PIN) && emit(pin);
+        }
+        if (error) return false;
+        char* end;
+        const float val = strtof(p, &end);
+        if (end == p) return fail("value expected");
+        p = end;
+        uint8_t buf[sizeof(float)];
+        memcpy(buf, &val, sizeof(buf));
+        if (!emit(EdgeRules::OP_CONST)) return false;
+        for (unsigned i = 0; i < sizeof(buf); i++) {
+            if (!emit(buf[i])) return false;
+        }
+        return true;
+    }
+
+    bool parseCompare() {
+        static const struct { const char* tok; uint8_t op; } ops[] = {
+            { ">=", EdgeRules::OP_GE }, { "<=", EdgeRules::OP_LE },
+            { "==", EdgeRules::OP_EQ }, { "!=", EdgeRules::OP_NE },
+            { ">",  EdgeRules::OP_GT }, { "<",  EdgeRules::OP_LT },
+        };
+        if (!parseOperand()) return false;
+        for (unsigned i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+            if (match(ops[i].tok)) {
+                return parseOperand() && emit(ops[i].op);
+            }
+        }
+        return fail("comparison expected");
+    }
+
+    bool parseAnd() {
+        if (!parseCompare()) return false;
+        while (match("&&") || match("and")) {
+            if (!parseCompare() || !emit(EdgeRules::OP_AND)) return false;
+        }
+        return true;
+    }
+
+    bool parseOr() {
+        if (!parseAnd()) return false;
+        while (match("||") || match("or")) {
+            if (!parseAnd() || !emit(EdgeRules::OP_OR)) return false;
+        }
+        return true;
+    }
+
+    bool parseAction() {
+        uint8_t pin;
+        if (parsePin(pin)) {
+            if (!match("=")) return fail("'=' expected");
+            return parseOperand() && emit(EdgeRules::OP_WRITE) && emit(pin);
+        }
+        if (error) return false;
+        if (match("event")) {
+            skipSpaces();
+            const char* name = p;
+            while (isalnum((unsigned char)*p) || *p == '_') p++;
+            const size_t n = p - name;
+            if (!n || n > RULE_EVENT_LEN) return fail("invalid event name");
+            if (!emit(EdgeRules::OP_EVENT) || !emit(n)) return false;
+            for (size_t i = 0; i < n; i++) {
+                if (!emit(name[i])) return false;
+            }
+            return true;
+        }
+        return fail("action expected");
+    }
+
+    bool parseRule() {
+        if (!emit(0)) return false;   // Length, patched below
+        const size_t start = len;
+        if (!parseOr()) return false;
+        if (!match("->")) return fail("'->' expected");
+        if (!emit(EdgeRules::OP_THEN)) return false;
+        do {
+            if (!parseAction()) return false;
+        } while (match(","));
+        if (!emit(EdgeRules::OP_END)) return false;
+        if (len - start > 255) return fail("rule too long");
+        out[start - 1] = len - start;
+        return true;
+    }
+
+    bool parse() {
+        for (;;) {
+            while (*p == '\n' || *p == ';' || isspace((unsigned char)*p)) p++;
+            if (!*p) return true;
+            if (!parseRule()) return false;
+            skipSpaces();
+            if (*p && *p != '\n' && *p != ';') return fail("end of rule expected");
+        }
+    }
+};
+
+} // namespace
+
+/*
+ * EdgeRules
+ */
+
+EdgeRules::EdgeRules()
+    : _codeLen(0)
+    , _count(0)
+    , _pinCount(0)
+    , _depth(0)
+    , _error(NULL)
+    , _onWrite(NULL)
+    , _onEvent(NULL)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool EdgeRules::compile(const char* text)
+{
+    uint8_t buf[EDGE_RULES_MAX_CODE];
+    Compiler c = { text, buf, 0, sizeof(buf), NULL };
+    if (!c.parse()) {
+        _error = c.error;
+        return false;
+    }
+    return load(buf, c.len);
+}
+
+bool EdgeRules::append(const char* text)
+{
+    // Rules are length-prefixed, so the new code is just concatenated
+    uint8_t buf[EDGE_RULES_MAX_CODE];
+    memcpy(buf, _code, _codeLen);
+    Compiler c = { text, buf, _codeLen, sizeof(buf), NULL };
+    if (!c.parse()) {
+        _error = c.error;
+        return false;
+    }
+    return load(buf, c.len);
+}
+
+bool EdgeRules::load(const uint8_t* code, size_t len)
+{
+    if (len > sizeof(_code) || !index(code, len)) {
+        if (!_error) _error = "invalid code";
+        return false;
+    }
+    memcpy(_code, code, len);
+    _codeLen = len;
+    _error = NULL;
+    return true;
+}
+
+void EdgeRules::clear()
+{
+    _codeLen = 0;
+    _count = 0;
+    _pinCount = 0;
+}
+
+// Validates the code, then builds the rule and pin tables
+bool EdgeRules::index(const uint8_t* code, size_t len)
+{
+    uint16_t offset[EDGE_RULES_MAX_COUNT];
+    uint32_t deps[EDGE_RULES_MAX_COUNT];
+    Pin      pins[EDGE_RULES_MAX_PINS];
+    unsigned count = 0, pinCount = 0;
+
+    _error = NULL;
+    size_t pos = 0;
+    while (pos < len) {
+        const size_t ruleLen = code[pos++];
+        const size_t end = pos + ruleLen;
+        if (!ruleLen || end > len) return false;
+        if (count == EDGE_RULES_MAX_COUNT) {
+            _error = "too many rules";
+            return false;
+        }
+        offset[count] = pos;
+        deps[count] = 0;
+
+        int sp = 0;
+        bool then = false;
+        while (pos < end) {
+            const uint8_t op = code[pos++];
+            switch (op) {
+            case OP_PIN:
+            case OP_WRITE: {
+                if (pos >= end) return false;
+                const uint8_t pin = code[pos++];
+                unsigned idx = 0;
+                while (idx < pinCount && pins[idx].pin != pin) idx++;
+                if (idx == pinCount) {
+                    if (pinCount == EDGE_RULES_MAX_PINS) {
+                        _error = "too many pins";
+                        return false;
+                    }
+                    // Keep the known values
+                    const int old = findPin(pin);
+                    pins[idx].pin = pin;
+                    pins[idx].value = (old >= 0) ? _pins[old].value : NAN;
+                    pinCount++;
+                }
+                if (op == OP_PIN) {
+                    if (++sp > RULE_STACK_SIZE) return false;
+                    if (!then) deps[count] |= (1UL << idx);
+                } else {
+                    if (!then || sp != 1) return false;
+                    sp--;
+                }
+            } break;
+            case OP_CONST:
+                if (pos + sizeof(float) > end) return false;
+                if (++sp > RULE_STACK_SIZE) return false;
+                pos += sizeof(float);
+                break;
+            case OP_GT: case OP_LT: case OP_GE: case OP_LE:
+            case OP_EQ: case OP_NE: case OP_AND: case OP_OR:
+                if (then || sp < 2) return false;
+                sp--;
+                break;
+            case OP_THEN:
+                if (then || sp != 1) return false;
+                then = true;
+                sp = 0;
+                break;
+            case OP_EVENT: {
+                if (!then || sp || pos >= end) return false;
+                const uint8_t n = code[pos++];
+                if (!n || n > RULE_EVENT_LEN || pos + n > end) return false;
+                pos += n;
+            } break;
+            case OP_END:
+                if (!then || sp || pos != end) return false;
+                break;
+            default:
+                return false;
+            }
+        }
+        if (code[end - 1] != OP_END) return false;
+        count++;
+    }
+
+    memcpy(_offset, offset, sizeof(offset));
+    memcpy(_deps, deps, sizeof(deps));
+    memcpy(_pins, pins, sizeof(pins));
+    memset(_active, 0, sizeof(_active));
+    _count = count;
+    _pinCount = pinCount;
+    return true;
+}
+
+int EdgeRules::findPin(uint8_t pin) const
+{
+    for (unsigned i = 0; i < _pinCount; i++) {
+        if (_pins[i].pin == pin) return i;
+    }
+    return -1;
+}
+
+void EdgeRules::update(uint8_t pin, float value)
+{
+    const int idx = findPin(pin);
+    if (idx < 0) return;
+
+    _pins[idx].value = value;
+    _stats.updates++;
+
+    // Actions may update pins, avoid endless loops
+    if (_depth >= RULE_MAX_DEPTH) return;
+    _depth++;
+    const uint32_t mask = (1UL << idx);
+    for (unsigned i = 0; i < _count; i++) {
+        if (_deps[i] & mask) {
+            evaluate(i);
+        }
+    }
+    _depth--;
+}
+
+bool EdgeRules::evaluate(unsigned rule)
+{
+    const uint8_t* p = _code + _offset[rule];
+    float stack[RULE_STACK_SIZE];
+    int sp = 0;
+
+    _stats.evaluated++;
+    for (;;) {
+        const uint8_t op = *p++;
+        if (op >= OP_GT && op <= OP_OR) {
+            const float a = stack[sp - 2];
+            const float b = stack[sp - 1];
+            bool res = false;
+            if (op == OP_AND || op == OP_OR) {
+                const bool ba = (a != 0 && !isnan(a));
+                const bool bb = (b != 0 && !isnan(b));
+                res = (op == OP_AND) ? (ba && bb) : (ba || bb);
+            } else if (!isnan(a) && !isnan(b)) {   // Unknown values never match
+                switch (op) {
+                case OP_GT:  res = (a >  b);  break;
+                case OP_LT:  res = (a <  b);  break;
+                case OP_GE:  res = (a >= b);  break;
+                case OP_LE:  res = (a <= b);  break;
+                case OP_EQ:  res = (a == b);  break;
+                case OP_NE:  res = (a != b);  break;
+                }
+            }
+            stack[--sp - 1] = res;
+            continue;
+        }
+
+        switch (op) {
+        case OP_PIN:
+            stack[sp++] = _pins[findPin(*p++)].value;
+            break;
+        case OP_CONST:
+            memcpy(&stack[sp++], p, sizeof(float));
+            p += sizeof(float);
+            break;
+        case OP_THEN: {
+            const bool cond = (stack[--sp] != 0);
+            const bool was = _active[rule];
+            _active[rule] = cond;
+            if (!cond || was) return false;
+            _stats.fired++;
+        } break;
+        case OP_WRITE: {
+            const uint8_t pin = *p++;
+            const float val = stack[--sp];
+            if (!isnan(val) && _onWrite) {
+                _onWrite(pin, val);
+            }
+        } break;
+        case OP_EVENT: {
+            const uint8_t n = *p++;
+            char name[RULE_EVENT_LEN + 1];
+            memcpy(name, p, n);
+            name[n] = '\0';
+            p += n;
+            if (_onEvent) {
+                _onEvent(name);
+            }
+        } break;
+        default: // OP_END
+            return true;
+        }
+    }
+}
+
+/*
+ * Decompiler
+ */
+
+size_t EdgeRules::print(char* buf, size_t len) const
+{
+    static const char* opStr[] = {
+        ">", "<", ">=", "<=", "==", "!=", "&&", "||"
+    };
+
+    size_t pos = 0;
+    bool full = false;
+    auto out = [&](const char* s) {
+        const size_t n = strlen(s);
+        if (full || pos + n >= len) {
+            full = true;
+            return;
+        }
+        memcpy(buf + pos, s, n);
+        pos += n;
+    };
+
+    for (unsigned r = 0; r < _count && !full; r++) {
+        const uint8_t* p = _code + _offset[r];
+        char stack[RULE_STACK_SIZE][64];
+        int sp = 0;
+        bool first = true;
+        for (bool done = false; !done; ) {
+            const uint8_t op = *p++;
+            if (op >= OP_GT && op <= OP_OR) {
+                char tmp[sizeof(stack[0]) * 2 + 8];
+                snprintf(tmp, sizeof(tmp), "%s %s %s",
+                         stack[sp - 2], opStr[op - OP_GT], stack[sp - 1]);
+                sp--;
+                const size_t n = strlen(tmp) < sizeof(stack[0]) ? strlen(tmp) : sizeof(stack[0]) - 1;
+                memcpy(stack[sp - 1], tmp, n);
+                stack[sp - 1][n] = '\0';
+                continue;
+            }
+            switch (op) {
+            case OP_PIN:
+                snprintf(stack[sp++], sizeof(stack[0]), "V%u", *p++);
+                break;
+            case OP_CONST: {
+                float val;
+                memcpy(&val, p, sizeof(float));
+                p += sizeof(float);
+                // Enough digits to read back the same float
+                snprintf(stack[sp++], sizeof(stack[0]), "%.9g", val);
+            } break;
+            case OP_THEN:
+                out(stack[--sp]);
+                out(" ->");
+                break;
+            case OP_WRITE: {
+                char tmp[80];
+                snprintf(tmp, sizeof(tmp), "%s V%u = %s", first ? "" : ",", *p++, stack[--sp]);
+                out(tmp);
+                first = false;
+            } break;
+            case OP_EVENT: {
+                const uint8_t n = *p++;
+                char tmp[RULE_EVENT_LEN + 16];
+                snprintf(tmp, sizeof(tmp), "%s event %.*s", first ? "" : ",", n, (const char*)p);
+                p += n;
+                out(tmp);
+                first = false;
+            } break;
+            default: // OP_END
+                out("\n");
+                done = true;
+            }
+        }
+    }
+    if (len) buf[pos] = '\0';
+    return pos;
+}
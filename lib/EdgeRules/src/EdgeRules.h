@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EdgeRules_h
+#define EdgeRules_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef EDGE_RULES_MAX_CODE
+#define EDGE_RULES_MAX_CODE     256     // bytes
+#endif
+
+#ifndef EDGE_RULES_MAX_COUNT
+#define EDGE_RULES_MAX_COUNT    16
+#endif
+
+#ifndef EDGE_RULES_MAX_PINS
+#define EDGE_RULES_MAX_PINS     32
+#endif
+
+/*
+ * Local automation rules, one per line:
+ *
+ *   V1 > 30 && V3 == 1 -> V2 = 1, event overheat
+ *   V1 <= 25 -> V2 = 0
+ *
+ * Rules are compiled to a compact stack bytecode and evaluated
+ * whenever one of the referenced pins is updated.
+ * Actions run once, when the condition becomes true.
+ *
+ * Code layout: [len][rule bytecode]... where each rule ends with OP_END.
+ */
+class EdgeRules {
+
+public:
+
+    enum Op {
+        OP_END = 0,
+        OP_PIN,         // u8 pin         -> push pin value
+        OP_CONST,       // f32            -> push constant
+        OP_GT,
+        OP_LT,
+        OP_GE,
+        OP_LE,
+        OP_EQ,
+        OP_NE,
+        OP_AND,
+        OP_OR,
+        OP_THEN,        // pop condition, stop unless it became true
+        OP_WRITE,       // u8 pin         <- pop value
+        OP_EVENT,       // u8 len, chars
+        OP_MAX_VALUE
+    };
+
+    typedef void (*WriteHandler)(uint8_t pin, float value);
+    typedef void (*EventHandler)(const char* event);
+
+    struct Stats {
+        uint32_t  updates;      // Updates of the referenced pins
+        uint32_t  evaluated;    // Rules evaluated
+        uint32_t  fired;
+    };
+
+    EdgeRules();
+
+    // Compiles the rules text, replacing the current rules.
+    // On error, the current rules are kept
+    bool compile(const char* text);
+
+    // Compiles the rules text and adds it after the current rules,
+    // whose code is kept as is. On error, the current rules are kept
+    bool append(const char* text);
+
+    // Loads previously compiled code, after validating it
+    bool load(const uint8_t* code, size_t len);
+
+    // Writes the rules as text. Output that does not fit is cut
+    // at a whole piece, and the rules after it are not printed
+    size_t print(char* buf, size_t len) const;
+
+    void clear();
+
+    void onWrite(WriteHandler h)    { _onWrite = h; }
+    void onEvent(EventHandler h)    { _onEvent = h; }
+
+    // Returns true if any of the rules depends on the pin
+    bool uses(uint8_t pin) const    { return findPin(pin) >= 0; }
+
+    // Stores the pin value and evaluates the dependent rules
+    void update(uint8_t pin, float value);
+
+    const uint8_t* code() const     { return _code; }
+    size_t   codeSize() const       { return _codeLen; }
+    unsigned count() const          { return _count; }
+    const char* getError() const    { return _error; }
+    const Stats& getStats() const   { return _stats; }
+
+private:
+    struct Pin {
+        uint8_t   pin;
+        float     value;        // NAN until the first update
+    };
+
+    int      findPin(uint8_t pin) const;
+    bool     index(const uint8_t* code, size_t len);
+    bool     evaluate(unsigned rule);
+
+private:
+    uint8_t   _code[EDGE_RULES_MAX_CODE];
+    size_t    _codeLen;
+
+    unsigned  _count;
+    uint16_t  _offset[EDGE_RULES_MAX_COUNT];
+    uint32_t  _deps[EDGE_RULES_MAX_COUNT];      // Bit mask of _pins indexes
+    bool      _active[EDGE_RULES_MAX_COUNT];    // Last condition result
+
+    Pin       _pins[EDGE_RULES_MAX_PINS];
+    unsigned  _pinCount;
+
+    unsigned  _depth;           // Nesting of update() calls made by actions
+    const char* _error;
+
+    WriteHandler  _onWrite;
+    EventHandler  _onEvent;
+    Stats     _stats;
+};
+
+#endif /* EdgeRules_h */
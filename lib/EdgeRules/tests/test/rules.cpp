@@ -0,0 +1,247 @@
+#include "unity.h"
+
+#include "EdgeRules.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+#define BENCH_COUNT   10000
+
+static uint64_t nowUs() {
+  return micros();
+}
+
+#else
+
+#include <time.h>
+
+#define BENCH_COUNT   100000
+
+static uint64_t nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
+
+static int   lastPin;
+static float lastValue;
+static int   writes;
+static char  lastEvent[40];
+static int   events;
+
+static void onWrite(uint8_t pin, float value) {
+  lastPin = pin;
+  lastValue = value;
+  writes++;
+}
+
+static void onEvent(const char* event) {
+  strcpy(lastEvent, event);
+  events++;
+}
+
+void setUp() {
+  lastPin = -1;
+  lastValue = 0;
+  writes = 0;
+  events = 0;
+  lastEvent[0] = '\0';
+}
+
+void tearDown() {
+}
+
+void test_threshold_fires_once() {
+  EdgeRules r;
+  r.onWrite(onWrite);
+  r.onEvent(onEvent);
+  TEST_ASSERT_TRUE(r.compile("V1 > 30 -> V2 = 1, event overheat"));
+  TEST_ASSERT_TRUE(r.uses(1));
+  TEST_ASSERT_FALSE(r.uses(3));
+
+  r.update(1, 25);
+  TEST_ASSERT_EQUAL_INT(0, writes);
+  r.update(1, 31);
+  TEST_ASSERT_EQUAL_INT(1, writes);
+  TEST_ASSERT_EQUAL_INT(2, lastPin);
+  TEST_ASSERT_EQUAL_FLOAT(1, lastValue);
+  TEST_ASSERT_EQUAL_STRING("overheat", lastEvent);
+
+  // Stays true: no more actions
+  r.update(1, 35);
+  TEST_ASSERT_EQUAL_INT(1, writes);
+
+  // Re-armed once the condition is false
+  r.update(1, 20);
+  r.update(1, 40);
+  TEST_ASSERT_EQUAL_INT(2, writes);
+  TEST_ASSERT_EQUAL_INT(2, events);
+}
+
+void test_logic_and_unknown_pins() {
+  EdgeRules r;
+  r.onWrite(onWrite);
+  TEST_ASSERT_TRUE(r.compile("V1 >= 10 && V2 == 1 || V3 < -5 -> V4 = V1"));
+
+  // V2 is unknown yet
+  r.update(1, 12);
+  TEST_ASSERT_EQUAL_INT(0, writes);
+  r.update(2, 1);
+  TEST_ASSERT_EQUAL_INT(1, writes);
+  TEST_ASSERT_EQUAL_INT(4, lastPin);
+  TEST_ASSERT_EQUAL_FLOAT(12, lastValue);
+
+  r.update(2, 0);
+  r.update(3, -6.5);
+  TEST_ASSERT_EQUAL_INT(2, writes);
+}
+
+void test_multiple_rules_and_print() {
+  EdgeRules r;
+  const char* text = "V1 > 30 -> V2 = 1\n"
+                     "V1 <= 25 -> V2 = 0, event cooled_down\n";
+  TEST_ASSERT_TRUE(r.compile(text));
+  TEST_ASSERT_EQUAL_UINT(2, r.count());
+
+  char buf[128];
+  r.print(buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING(text, buf);
+
+  // Printed text compiles to the same code
+  EdgeRules r2;
+  TEST_ASSERT_TRUE(r2.compile(buf));
+  TEST_ASSERT_EQUAL_UINT(r.codeSize(), r2.codeSize());
+  TEST_ASSERT_EQUAL_MEMORY(r.code(), r2.code(), r.codeSize());
+}
+
+void test_append_keeps_code() {
+  EdgeRules r;
+  TEST_ASSERT_TRUE(r.compile("V1 > 1234567.8 -> V2 = 0.1234567"));
+  uint8_t code[EDGE_RULES_MAX_CODE];
+  const size_t len = r.codeSize();
+  memcpy(code, r.code(), len);
+
+  TEST_ASSERT_TRUE(r.append("V3 < 0 -> event frozen"));
+  TEST_ASSERT_EQUAL_UINT(2, r.count());
+  TEST_ASSERT_EQUAL_MEMORY(code, r.code(), len);
+
+  // Constants survive a print and compile round trip
+  char buf[128];
+  r.print(buf, sizeof(buf));
+  EdgeRules r2;
+  TEST_ASSERT_TRUE(r2.compile(buf));
+  TEST_ASSERT_EQUAL_UINT(r.codeSize(), r2.codeSize());
+  TEST_ASSERT_EQUAL_MEMORY(r.code(), r2.code(), r.codeSize());
+
+  TEST_ASSERT_FALSE(r.append("V4 >"));
+  TEST_ASSERT_EQUAL_UINT(2, r.count());
+}
+
+void test_syntax_errors_keep_rules() {
+  EdgeRules r;
+  TEST_ASSERT_TRUE(r.compile("V1 > 1 -> V2 = 1"));
+  TEST_ASSERT_FALSE(r.compile("V1 > -> V2 = 1"));
+  TEST_ASSERT_NOT_NULL(r.getError());
+  TEST_ASSERT_FALSE(r.compile("V1 > 1 V2 = 1"));
+  TEST_ASSERT_FALSE(r.compile("V1 > 1 -> reboot"));
+  TEST_ASSERT_EQUAL_UINT(1, r.count());
+  TEST_ASSERT_TRUE(r.uses(1));
+}
+
+void test_load_rejects_invalid_code() {
+  EdgeRules r;
+  TEST_ASSERT_TRUE(r.compile("V1 > 1 -> V2 = 1"));
+
+  uint8_t code[EDGE_RULES_MAX_CODE];
+  memcpy(code, r.code(), r.codeSize());
+  const size_t len = r.codeSize();
+
+  EdgeRules r2;
+  TEST_ASSERT_TRUE(r2.load(code, len));
+
+  // Truncated
+  TEST_ASSERT_FALSE(r2.load(code, len - 1));
+  // Unknown opcode
+  code[1] = 0xFF;
+  TEST_ASSERT_FALSE(r2.load(code, len));
+  // Stack underflow
+  code[1] = EdgeRules::OP_GT;
+  TEST_ASSERT_FALSE(r2.load(code, len));
+}
+
+void test_action_loops_are_bounded() {
+  static EdgeRules r;
+  r.onWrite([](uint8_t pin, float value) {
+    writes++;
+    r.update(pin, value);
+  });
+  // Each rule triggers the other one
+  TEST_ASSERT_TRUE(r.compile("V1 > 0 -> V1 = 0\n"
+                             "V1 <= 0 -> V1 = 1\n"));
+  r.update(1, 1);
+  TEST_ASSERT_TRUE(writes > 0 && writes <= 4);
+}
+
+// Evaluation cost per pin update, reported with TEST_MESSAGE
+void test_benchmark() {
+  EdgeRules r;
+  r.onWrite(onWrite);
+  r.onEvent(onEvent);
+  r.compile("V1 > 30 && V2 == 1 -> V10 = 1, event overheat\n"
+            "V1 <= 25 -> V10 = 0\n"
+            "V3 > 80 || V4 < 10 -> event alarm\n"
+            "V5 != V6 -> V11 = V5\n");
+
+  const uint64_t t0 = nowUs();
+  for (int i = 0; i < BENCH_COUNT; i++) {
+    r.update(1 + (i % 6), (i * 7) % 100);
+  }
+  const uint64_t t1 = nowUs();
+
+  const EdgeRules::Stats& st = r.getStats();
+  TEST_ASSERT_EQUAL_UINT32(BENCH_COUNT, st.updates);
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%u rules, %u bytes: %.3f us/update, %.3f us/rule, %u fired",
+           r.count(), (unsigned)r.codeSize(),
+           double(t1 - t0) / BENCH_COUNT, double(t1 - t0) / st.evaluated,
+           (unsigned)st.fired);
+  TEST_MESSAGE(msg);
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_threshold_fires_once);
+  RUN_TEST(test_logic_and_unknown_pins);
+  RUN_TEST(test_multiple_rules_and_print);
+  RUN_TEST(test_append_keeps_code);
+  RUN_TEST(test_syntax_errors_keep_rules);
+  RUN_TEST(test_load_rejects_invalid_code);
+  RUN_TEST(test_action_loops_are_bounded);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
+
+#if defined(ARDUINO)
+
+void setup() {
+  delay(1000);
+
+  runUnityTests();
+}
+
+void loop() {
+}
+
+#else
+
+int main() {
+  return runUnityTests();
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "LzStream.h"
+
+#include <string.h>
+
+#define WINDOW_MASK     (LZ_WINDOW_SIZE - 1)
+
+static_assert(LZ_WINDOW_BITS + LZ_LENGTH_BITS + 1 <= 24, "Token does not fit the bit buffer");
+
+/*
+ * Encoder
+ */
+
+LzEncoder::LzEncoder(LzSink sink, void* ctx)
+    : _sink(sink)
+    , _ctx(ctx)
+{
+    reset();
+}
+
+void LzEncoder::reset()
+{
+    _histPos = _histLen = 0;
+    _lookLen = 0;
+    _bitBuf = _bitCount = 0;
+    _outLen = 0;
+    _inSize = _outSize = 0;
+}
+
+void LzEncoder::write(const void* data, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    _inSize += len;
+    while (len--) {
+        _look[_lookLen++] = *p++;
+        if (_lookLen == LZ_MAX_MATCH) {
+            step();
+        }
+    }
+}
+
+void LzEncoder::finish()
+{
+    while (_lookLen) {
+        step();
+    }
+    if (_bitCount) {
+        putBits(0, 8 - _bitCount);
+    }
+    flushOut();
+}
+
+// Match bytes may overlap the lookahead (i.e. runs)
+uint8_t LzEncoder::byteAt(unsigned dist, unsigned i) const
+{
+    if (i < dist) {
+        return _hist[(_histPos - dist + i) & WINDOW_MASK];
+    }
+    return _look[i - dist];
+}
+
+void LzEncoder::step()
+{
+    unsigned bestLen = 0, bestDist = 0;
+    for (unsigned dist = 1; dist <= _histLen; dist++) {
+        if (byteAt(dist, 0) != _look[0]) continue;
+        unsigned len = 1;
+        while (len < _lookLen && byteAt(dist, len) == _look[len]) {
+            len++;
+        }
+        if (len > bestLen) {
+            bestLen = len;
+            bestDist = dist;
+            if (len == _lookLen) break;
+        }
+    }
+
+    unsigned consumed;
+    if (bestLen >= LZ_MIN_MATCH) {
+        putBits(0, 1);
+        putBits(bestDist - 1, LZ_WINDOW_BITS);
+        putBits(bestLen - LZ_MIN_MATCH, LZ_LENGTH_BITS);
+        consumed = bestLen;
+    } else {
+        putBits(1, 1);
+        putBits(_look[0], 8);
+        consumed = 1;
+    }
+
+    for (unsigned i = 0; i < consumed; i++) {
+        _hist[_histPos] = _look[i];
+        _histPos = (_histPos + 1) & WINDOW_MASK;
+    }
+    if (_histLen < LZ_WINDOW_SIZE) {
+        _histLen = (_histLen + consumed < LZ_WINDOW_SIZE) ? _histLen + consumed : LZ_WINDOW_SIZE;
+    }
+    _lookLen -= consumed;
+    memmove(_look, _look + consumed, _lookLen);
+}
+
+void LzEncoder::putBits(uint32_t value, unsigned bits)
+{
+    _bitBuf = (_bitBuf << bits) | (value & ((1UL << bits) - 1));
+    _bitCount += bits;
+    while (_bitCount >= 8) {
+        _bitCount -= 8;
+        _out[_outLen++] = _bitBuf >> _bitCount;
+        if (_outLen == sizeof(_out)) {
+            flushOut();
+        }
+    }
+}
+
+void LzEncoder::flushOut()
+{
+    if (_outLen) {
+        _sink(_out, _outLen, _ctx);
+        _outSize += _outLen;
+        _outLen = 0;
+    }
+}
+
+/*
+ * Decoder
+ */
+
+LzDecoder::LzDecoder(LzSink sink, void* ctx)
+    : _sink(sink)
+    , _ctx(ctx)
+{
+    reset();
+}
+
+void LzDecoder::reset()
+{
+    _histPos = _histLen = 0;
+    _state = TAG;
+    _dist = 0;
+    _bitBuf = _bitCount = 0;
+    _outLen = 0;
+    _outSize = 0;
+    _error = false;
+}
+
+bool LzDecoder::getBits(unsigned bits, uint32_t& value)
+{
+    if (_bitCount < bits) return false;
+    _bitCount -= bits;
+    value = (_bitBuf >> _bitCount) & ((1UL << bits) - 1);
+    return true;
+}
+
+void LzDecoder::write(const void* data, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (len--) {
+        _bitBuf = (_bitBuf << 8) | *p++;
+        _bitCount += 8;
+
+        uint32_t v;
+        for (bool more = true; more; ) {
+            switch (_state) {
+            case TAG:
+                if ((more = getBits(1, v))) {
+                    _state = v ? LITERAL : DISTANCE;
+                }
+                break;
+            case LITERAL:
+                if ((more = getBits(8, v))) {
+                    putByte(v);
+                    _state = TAG;
+                }
+                break;
+            case DISTANCE:
+                if ((more = getBits(LZ_WINDOW_BITS, v))) {
+                    _dist = v + 1;
+                    _state = LENGTH;
+                }
+                break;
+            case LENGTH:
+                if ((more = getBits(LZ_LENGTH_BITS, v))) {
+                    if (_dist > _histLen) {
+                        _error = true;
+                    } else {
+                        for (unsigned i = 0; i < v + LZ_MIN_MATCH; i++) {
+                            putByte(_hist[(_histPos - _dist) & WINDOW_MASK]);
+                        }
+                    }
+                    _state = TAG;
+                }
+                break;
+            }
+        }
+    }
+}
+
+void LzDecoder::putByte(uint8_t b)
+{
+    _hist[_histPos] = b;
+    _histPos = (_histPos + 1) & WINDOW_MASK;
+    if (_histLen < LZ_WINDOW_SIZE) {
+        _histLen++;
+    }
+    _out[_outLen++] = b;
+    if (_outLen == sizeof(_out)) {
+        flushOut();
+    }
+}
+
+void LzDecoder::flushOut()
+{
+    if (_outLen) {
+        _sink(_out, _outLen, _ctx);
+        _outSize += _outLen;
+        _outLen = 0;
+    }
+}
+
+/*
+ * Helpers
+ */
+
+namespace {
+
+struct BufferSink {
+    uint8_t*  buf;
+    size_t    cap;
+    size_t    len;
+    bool      overflow;
+
+    static void write(const uint8_t* data, size_t len, void* ctx) {
+        BufferSink* s = (BufferSink*)ctx;
+        if (s->len + len > s->cap) {
+            s->overflow = true;
+            return;
+        }
+        memcpy(s->buf + s->len, data, len);
+        s->len += len;
+    }
+};
+
+} // namespace
+
+size_t lzCompress(const void* in, size_t len, uint8_t* out, size_t cap)
+{
+    LzEncoder enc(NULL, NULL);
+    return lzCompress(enc, in, len, out, cap);
+}
+
+size_t lzCompress(LzEncoder& enc, const void* in, size_t len, uint8_t* out, size_t cap)
+{
+    BufferSink sink = { out, cap, 0, false };
+    enc.setSink(BufferSink::write, &sink);
+    enc.reset();
+    enc.write(in, len);
+    enc.finish();
+    enc.setSink(NULL, NULL);
+    return sink.overflow ? 0 : sink.len;
+}
+
+size_t lzDecompress(const void* in, size_t len, uint8_t* out, size_t cap)
+{
+    BufferSink sink = { out, cap, 0, false };
+    LzDecoder dec(BufferSink::write, &sink);
+    dec.write(in, len);
+    dec.finish();
+    return (sink.overflow || dec.hasError()) ? 0 : sink.len;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LzStream_h
+#define LzStream_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef LZ_WINDOW_BITS
+#define LZ_WINDOW_BITS      8       // 256 bytes of history
+#endif
+
+#ifndef LZ_LENGTH_BITS
+#define LZ_LENGTH_BITS      4       // Matches of 2..17 bytes
+#endif
+
+#define LZ_WINDOW_SIZE      (1 << LZ_WINDOW_BITS)
+#define LZ_MIN_MATCH        2
+#define LZ_MAX_MATCH        (LZ_MIN_MATCH + (1 << LZ_LENGTH_BITS) - 1)
+
+/*
+ * Streaming LZSS, in the spirit of heatshrink.
+ *
+ * Bit stream (MSB first):
+ *   1 <8 bits>                             literal byte
+ *   0 <WINDOW_BITS> <LENGTH_BITS>          back-reference: distance-1, length-MIN_MATCH
+ *
+ * The last byte is zero-padded, which can't be mistaken for a token.
+ * Both sides need only the window and a few bytes of state.
+ */
+
+typedef void (*LzSink)(const uint8_t* data, size_t len, void* ctx);
+
+class LzEncoder {
+
+public:
+    LzEncoder(LzSink sink, void* ctx);
+
+    void reset();
+    void setSink(LzSink sink, void* ctx)  { _sink = sink; _ctx = ctx; }
+    void write(const void* data, size_t len);
+    void finish();
+
+    uint32_t inputSize() const    { return _inSize; }
+    uint32_t outputSize() const   { return _outSize; }
+
+private:
+    void     step();
+    uint8_t  byteAt(unsigned dist, unsigned i) const;
+    void     putBits(uint32_t value, unsigned bits);
+    void     flushOut();
+
+private:
+    LzSink    _sink;
+    void*     _ctx;
+
+    uint8_t   _hist[LZ_WINDOW_SIZE];
+    unsigned  _histPos;
+    unsigned  _histLen;
+    uint8_t   _look[LZ_MAX_MATCH];
+    unsigned  _lookLen;
+
+    uint32_t  _bitBuf;
+    unsigned  _bitCount;
+    uint8_t   _out[32];
+    unsigned  _outLen;
+
+    uint32_t  _inSize;
+    uint32_t  _outSize;
+};
+
+class LzDecoder {
+
+public:
+    LzDecoder(LzSink sink, void* ctx);
+
+    void reset();
+    void write(const void* data, size_t len);
+    void finish()                 { flushOut(); }
+
+    uint32_t outputSize() const   { return _outSize; }
+    bool     hasError() const     { return _error; }
+
+private:
+    bool     getBits(unsigned bits, uint32_t& value);
+    void     putByte(uint8_t b);
+    void     flushOut();
+
+private:
+    enum State { TAG, LITERAL, DISTANCE, LENGTH };
+
+    LzSink    _sink;
+    void*     _ctx;
+
+    uint8_t   _hist[LZ_WINDOW_SIZE];
+    unsigned  _histPos;
+    unsigned  _histLen;
+
+    State     _state;
+    unsigned  _dist;
+    uint32_t  _bitBuf;
+    unsigned  _bitCount;
+    uint8_t   _out[32];
+    unsigned  _outLen;
+
+    uint32_t  _outSize;
+    bool      _error;       // Reference beyond the decoded data
+};
+
+// One-shot helpers, return 0 if the output does not fit
+size_t lzCompress(const void* in, size_t len, uint8_t* out, size_t cap);
+size_t lzDecompress(const void* in, size_t len, uint8_t* out, size_t cap);
+
+// Same, with the encoder state provided by the caller (i.e. not on the stack)
+size_t lzCompress(LzEncoder& enc, const void* in, size_t len, uint8_t* out, size_t cap);
+
+#endif /* LzStream_h */
@@ -0,0 +1,235 @@
+#include "unity.h"
+
+#include "LzStream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+#define BENCH_ROUNDS   20
+
+static uint64_t nowUs() {
+  return micros();
+}
+
+#else
+
+#include <time.h>
+
+#define BENCH_ROUNDS   200
+
+static uint64_t nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
+
+// Representative payloads
+static const char SYS_INFO[] =
+  " Device:      Particle Argon @ 64 MHz\n"
+  " Firmware:    0.1.0 (build Oct 19 2026 10:00:00)\n"
+  " Device OS:   5.5.0\n"
+  " Token:       aBcD - •••• - •••• - ••••\n"
+  " Platform:    Blynk Edgent Particle\n"
+  " Reset cause: Power On\n"
+  " Uptime:      1d 03:12:45\n"
+  " UTC time:    2026-10-19 10:00:00 (particle, drift 12.5 ppm)\n"
+  " Stats:       MCU: 1200 Power: 1 Watchdog: 0 Pin: 0 Other: 3\n"
+  " Network:     OK: 14, Fail: 2, Timeout: 1, Error: 0\n"
+  " Cloud:       OK: 12, Fail: 1, Timeout: 0, Error: 2, Auth: 0\n"
+  " Telemetry:   Queued: 120, Dropped: 0, Flushed: 120\n"
+  " Coalesced:   Writes: 45, Bytes: 1024\n"
+  " Filtered:    230\n"
+  " Sampling:    Samples: 6000, Uploads: 100, Values: 400\n"
+  " Shadow:      Skipped: 3, Suppressed: 12, Resynced: 4\n"
+  " Outbox:      Sent: 2400, Deferred: 35, Dropped: 0, Max depth: 6\n"
+  " Outbox wait: Max: 820 ms, Avg: 95 ms\n";
+
+static void makeJsonBatch(char* buf, size_t cap) {
+  size_t len = 0;
+  len += snprintf(buf + len, cap - len, "[");
+  for (int i = 0; i < 40 && len < cap - 80; i++) {
+    len += snprintf(buf + len, cap - len,
+                    "%s{\"pin\":%d,\"ts\":%llu,\"value\":%.2f}",
+                    i ? "," : "", 1 + i % 4, 1760868000000ULL + i * 10000ULL,
+                    20.0 + (i % 7) * 0.25);
+  }
+  snprintf(buf + len, cap - len, "]");
+}
+
+struct Collector {
+  uint8_t buf[8192];
+  size_t  len;
+
+  static void write(const uint8_t* data, size_t len, void* ctx) {
+    Collector* c = (Collector*)ctx;
+    TEST_ASSERT_TRUE(c->len + len <= sizeof(c->buf));
+    memcpy(c->buf + c->len, data, len);
+    c->len += len;
+  }
+};
+
+static void roundtrip(const void* data, size_t len) {
+  static uint8_t comp[8192], dec[8192];
+  const size_t clen = lzCompress(data, len, comp, sizeof(comp));
+  TEST_ASSERT_TRUE(clen || !len);
+  const size_t dlen = lzDecompress(comp, clen, dec, sizeof(dec));
+  TEST_ASSERT_EQUAL_UINT(len, dlen);
+  TEST_ASSERT_EQUAL_INT(0, memcmp(data, dec, len));
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_roundtrip() {
+  roundtrip("", 0);
+  roundtrip("a", 1);
+  roundtrip("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 48);
+  roundtrip("abcabcabcabcabcXabcabc", 22);
+  roundtrip(SYS_INFO, strlen(SYS_INFO));
+
+  static char json[4096];
+  makeJsonBatch(json, sizeof(json));
+  roundtrip(json, strlen(json));
+
+  // Incompressible data, longer than the window
+  static uint8_t rnd[3000];
+  srand(1);
+  for (size_t i = 0; i < sizeof(rnd); i++) rnd[i] = rand();
+  roundtrip(rnd, sizeof(rnd));
+}
+
+void test_literals_cost_one_bit() {
+  uint8_t comp[16];
+  // 8 literals = 72 bits
+  TEST_ASSERT_EQUAL_UINT(9, lzCompress("01234567", 8, comp, sizeof(comp)));
+  // A run is a literal and back-references
+  TEST_ASSERT_TRUE(lzCompress("0000000000000000", 16, comp, sizeof(comp)) <= 4);
+}
+
+void test_streaming_matches_oneshot() {
+  const size_t len = strlen(SYS_INFO);
+  uint8_t whole[2048];
+  const size_t wlen = lzCompress(SYS_INFO, len, whole, sizeof(whole));
+
+  // Uneven chunks on both sides
+  static Collector comp;
+  comp.len = 0;
+  LzEncoder enc(Collector::write, &comp);
+  for (size_t i = 0; i < len; i += 7) {
+    enc.write(SYS_INFO + i, (len - i < 7) ? len - i : 7);
+  }
+  enc.finish();
+  TEST_ASSERT_EQUAL_UINT(wlen, comp.len);
+  TEST_ASSERT_EQUAL_INT(0, memcmp(whole, comp.buf, wlen));
+  TEST_ASSERT_EQUAL_UINT(len, enc.inputSize());
+  TEST_ASSERT_EQUAL_UINT(wlen, enc.outputSize());
+
+  static Collector out;
+  out.len = 0;
+  LzDecoder dec(Collector::write, &out);
+  for (size_t i = 0; i < comp.len; i++) {
+    dec.write(comp.buf + i, 1);
+  }
+  dec.finish();
+  TEST_ASSERT_FALSE(dec.hasError());
+  TEST_ASSERT_EQUAL_UINT(len, out.len);
+  TEST_ASSERT_EQUAL_INT(0, memcmp(SYS_INFO, out.buf, len));
+}
+
+void test_reused_encoder() {
+  static uint8_t whole[2048], comp[2048];
+  const size_t len = strlen(SYS_INFO);
+  const size_t wlen = lzCompress(SYS_INFO, len, whole, sizeof(whole));
+
+  static LzEncoder enc(NULL, NULL);
+  for (int i = 0; i < 2; i++) {
+    TEST_ASSERT_EQUAL_UINT(wlen, lzCompress(enc, SYS_INFO, len, comp, sizeof(comp)));
+    TEST_ASSERT_EQUAL_INT(0, memcmp(whole, comp, wlen));
+  }
+}
+
+void test_overflow_and_corrupt() {
+  uint8_t small[16];
+  TEST_ASSERT_EQUAL_UINT(0, lzCompress(SYS_INFO, strlen(SYS_INFO), small, sizeof(small)));
+
+  uint8_t comp[2048], dec[64];
+  const size_t clen = lzCompress(SYS_INFO, strlen(SYS_INFO), comp, sizeof(comp));
+  TEST_ASSERT_EQUAL_UINT(0, lzDecompress(comp, clen, dec, sizeof(dec)));
+
+  // Back-reference before any data
+  const uint8_t bad[] = { 0x00, 0x00 };
+  TEST_ASSERT_EQUAL_UINT(0, lzDecompress(bad, sizeof(bad), dec, sizeof(dec)));
+}
+
+// Ratio and CPU cost, reported with TEST_MESSAGE
+static void bench(const char* name, const char* data) {
+  static uint8_t comp[8192], dec[8192];
+  const size_t len = strlen(data);
+
+  size_t clen = 0;
+  const uint64_t t0 = nowUs();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    clen = lzCompress(data, len, comp, sizeof(comp));
+  }
+  const uint64_t t1 = nowUs();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    lzDecompress(comp, clen, dec, sizeof(dec));
+  }
+  const uint64_t t2 = nowUs();
+
+  char msg[160];
+  snprintf(msg, sizeof(msg),
+           "%s: %u -> %u bytes (%.1f%%), compress %.1f us/KB, decompress %.1f us/KB",
+           name, (unsigned)len, (unsigned)clen, 100.0 * clen / len,
+           double(t1 - t0) * 1024 / (len * BENCH_ROUNDS),
+           double(t2 - t1) * 1024 / (len * BENCH_ROUNDS));
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(clen > 0 && clen < len * 3 / 4);
+}
+
+void test_benchmark() {
+  static char json[4096];
+  makeJsonBatch(json, sizeof(json));
+  bench("sys info", SYS_INFO);
+  bench("JSON batch", json);
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_roundtrip);
+  RUN_TEST(test_literals_cost_one_bit);
+  RUN_TEST(test_streaming_matches_oneshot);
+  RUN_TEST(test_reused_encoder);
+  RUN_TEST(test_overflow_and_corrupt);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
+
+#if defined(ARDUINO)
+
+void setup() {
+  delay(1000);
+
+  runUnityTests();
+}
+
+void loop() {
+}
+
+#else
+
+int main() {
+  return runUnityTests();
+}
+
+#endif
@@ -155,6 +155,56 @@ struct NetMgrClass {
         return false;
     }
 
+    bool isAnyLinkUp() {
+#ifdef NetMgr_WiFi
+        if (NetMgrWiFi.isLinkUp())     { return true; }
+#endif
+#ifdef NetMgr_Ethernet
+        if (NetMgrEthernet.isLinkUp()) { return true; }
+#endif
+#ifdef NetMgr_Cellular
+        if (NetMgrCellular.isLinkUp()) { return true; }
+#endif
+        return false;
+    }
+
+    // The first connected interface, in the same order as resolve()
+    const char* getConnectedInterface() {
+#ifdef NetMgr_WiFi
+        if (NetMgrWiFi.isConnected())     { return "wifi"; }
+#endif
+#ifdef NetMgr_Ethernet
+        if (NetMgrEthernet.isConnected()) { return "eth"; }
+#endif
+#ifdef NetMgr_Cellular
+        if (NetMgrCellular.isConnected()) { return "cell"; }
+#endif
+        return "none";
+    }
+
+    IPAddress resolve(const String& host) {
+        IPAddress result;
+#ifdef NetMgr_WiFi
+        if (NetMgrWiFi.isConnected()) {
+            result = NetMgrWiFi.resolve(host);
+            if (ipIsValid(result))     { return result; }
+        }
+#endif
+#ifdef NetMgr_Ethernet
+        if (NetMgrEthernet.isConnected()) {
+            result = NetMgrEthernet.resolve(host);
+            if (ipIsValid(result))     { return result; }
+        }
+#endif
+#ifdef NetMgr_Cellular
+        if (NetMgrCellular.isConnected()) {
+            result = NetMgrCellular.resolve(host);
+            if (ipIsValid(result))     { return result; }
+        }
+#endif
+        return result;
+    }
+
     bool isAnyConfigured() {
 #ifdef NetMgr_WiFi
         if (NetMgrWiFi.isConfigured())     { return true; }
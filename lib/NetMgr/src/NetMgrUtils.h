@@ -58,6 +58,17 @@ String ipToString(IPAddress ip) {
   return String(buff);
 }
 
+static inline
+IPAddress ipFromString(const String& s) {
+  unsigned a = 0, b = 0, c = 0, d = 0;
+  if (4 == sscanf(s.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) &&
+      a < 256 && b < 256 && c < 256 && d < 256)
+  {
+    return IPAddress(a, b, c, d);
+  }
+  return IPAddress();
+}
+
 static inline
 bool ipIsValid(IPAddress ip) {
   return ip[0] || ip[1] || ip[2] || ip[3];
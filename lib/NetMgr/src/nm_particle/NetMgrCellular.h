@@ -57,6 +57,11 @@ public:
         return Cellular.ready();
     }
 
+    bool isLinkUp() {
+        // No way to detect link before address is assigned
+        return Cellular.ready();
+    }
+
     String getModemName() {
         return "Built-in";
     }
@@ -87,6 +92,10 @@ public:
         return Cellular.localIP().toString();
     }
 
+    IPAddress resolve(const String& host) {
+        return Cellular.resolve(host.c_str());
+    }
+
     int getSignalStrength() {
         CellularSignal sig = Cellular.RSSI();
         return sig.getStrength();
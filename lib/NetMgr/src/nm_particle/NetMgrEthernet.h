@@ -58,6 +58,11 @@ public:
         return Ethernet.ready();
     }
 
+    bool isLinkUp() {
+        // No way to detect link before address is assigned
+        return Ethernet.ready();
+    }
+
     const char* getErrorStr() {
         return NULL;
     }
@@ -77,6 +82,10 @@ public:
         return Ethernet.localIP().toString();
     }
 
+    IPAddress resolve(const String& host) {
+        return Ethernet.resolve(host.c_str());
+    }
+
     String getStatus() {
         if (Ethernet.connecting()) {
           return Ethernet.localIP() ? "down" : "up";
@@ -63,6 +63,11 @@ public:
         return WiFi.ready();
     }
 
+    bool isLinkUp() {
+        // Associated with AP (RSSI is valid), but IP may be not assigned yet
+        return WiFi.ready() || (WiFi.connecting() && int(WiFi.RSSI()) < 0);
+    }
+
     const char* getErrorStr() {
         return NULL;
     }
@@ -82,6 +87,10 @@ public:
         return WiFi.localIP().toString();
     }
 
+    IPAddress resolve(const String& host) {
+        return WiFi.resolve(host.c_str());
+    }
+
     String getStatus() {
         if (WiFi.connecting()) {
           return WiFi.localIP() ? "down" : "up";
@@ -168,6 +177,32 @@ public:
         return true;
     }
 
+    bool hasNetwork(const String& ssid) {
+        WiFiAccessPoint stored[5];
+        const int found = WiFi.getCredentials(stored, 5);
+        for (int i = 0; i < found; i++) {
+            if (ssid == stored[i].ssid) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Device OS can only clear all of the credentials,
+    // so a network is removed only if no other networks are stored
+    bool removeNetwork(const String& ssid) {
+        WiFiAccessPoint stored[5];
+        const int found = WiFi.getCredentials(stored, 5);
+        for (int i = 0; i < found; i++) {
+            if (ssid != stored[i].ssid) {
+                LOG_W("Cannot remove %s, other networks are stored", ssid.c_str());
+                return false;
+            }
+        }
+        WiFi.clearCredentials();
+        return true;
+    }
+
     void clearNetworks() {
         WiFi.clearCredentials();
     }
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "TelemetryJournal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define CURSOR_FILE     "cursor"
+#define SEGMENT_PREFIX  "seg"
+
+static const size_t RECORD_SIZE = sizeof(TelemetryJournal::Record);
+
+TelemetryJournal::TelemetryJournal()
+    : _perSegment(0)
+    , _maxSegments(0)
+    , _syncEvery(1)
+    , _unsynced(0)
+    , _started(false)
+    , _head(0)
+    , _tail(0)
+    , _committed(0)
+    , _fd(-1)
+    , _fdSegment(0)
+    , _rfd(-1)
+    , _rfdSegment(0)
+{
+    _dir[0] = '\0';
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool TelemetryJournal::begin(const char* dir, unsigned perSegment, unsigned maxSegments,
+                             unsigned syncEvery)
+{
+    if (_started) return true;
+    if (!perSegment || maxSegments < 2) return false;
+
+    strncpy(_dir, dir, sizeof(_dir) - 1);
+    _dir[sizeof(_dir) - 1] = '\0';
+    _perSegment = perSegment;
+    _maxSegments = maxSegments;
+    _syncEvery = syncEvery ? syncEvery : 1;
+    _unsynced = 0;
+
+    mkdir(_dir, 0777);
+
+    // Find the range of existing segments
+    DIR* d = opendir(_dir);
+    if (!d) return false;
+    bool found = false;
+    uint32_t first = 0, last = 0;
+    while (struct dirent* ent = readdir(d)) {
+        if (strncmp(ent->d_name, SEGMENT_PREFIX, strlen(SEGMENT_PREFIX))) continue;
+        const uint32_t seg = strtoul(ent->d_name + strlen(SEGMENT_PREFIX), NULL, 10);
+        if (!found || seg < first) first = seg;
+        if (!found || seg > last)  last  = seg;
+        found = true;
+    }
+    closedir(d);
+
+    _head = _tail = 0;
+    if (found) {
+        // A torn record at the end is overwritten by the next append
+        char path[64];
+        segmentPath(path, sizeof(path), last);
+        struct stat st;
+        uint32_t count = 0;
+        if (stat(path, &st) == 0) {
+            count = st.st_size / RECORD_SIZE;
+        }
+        _head = last * _perSegment + count;
+        _tail = first * _perSegment;
+
+        uint32_t cursor;
+        if (loadCursor(cursor) && cursor > _tail && cursor <= _head) {
+            _tail = cursor;
+        }
+    }
+    _committed = _tail;
+    _started = true;
+    return true;
+}
+
+void TelemetryJournal::end()
+{
+    closeAll();
+    _started = false;
+}
+
+bool TelemetryJournal::append(uint8_t pin, uint64_t ts, uint8_t flags, const char* value)
+{
+    if (!_started) return false;
+
+    const uint32_t seg = _head / _perSegment;
+    if (_fd < 0 || _fdSegment != seg) {
+        sync();
+        if (_fd >= 0) {
+            close(_fd);
+            _fd = -1;
+        }
+        // Erase the oldest segment to make space
+        while (seg - _tail / _perSegment >= _maxSegments) {
+            const uint32_t oldest = _tail / _perSegment;
+            removeSegment(oldest);
+            const uint32_t next = (oldest + 1) * _perSegment;
+            _stats.dropped += next - _tail;
+            _tail = _committed = next;
+        }
+        char path[64];
+        segmentPath(path, sizeof(path), seg);
+        _fd = open(path, O_RDWR | O_CREAT, 0666);
+        if (_fd < 0) return false;
+        _fdSegment = seg;
+    }
+
+    Record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.ts = ts;
+    rec.seq = _head;
+    rec.pin = pin;
+    rec.flags = flags;
+    strncpy(rec.value, value, sizeof(rec.value) - 1);
+    rec.crc = crc32(&rec, offsetof(Record, crc));
+
+    const off_t offset = (off_t)(_head % _perSegment) * RECORD_SIZE;
+    if (lseek(_fd, offset, SEEK_SET) != offset ||
+        write(_fd, &rec, RECORD_SIZE) != (ssize_t)RECORD_SIZE)
+    {
+        return false;
+    }
+
+    _stats.bytesWritten += RECORD_SIZE;
+    _stats.appended++;
+    _head++;
+    if (++_unsynced >= _syncEvery) {
+        sync();
+    }
+    return true;
+}
+
+bool TelemetryJournal::sync()
+{
+    if (_fd < 0 || !_unsynced) return true;
+    _unsynced = 0;
+    _stats.syncs++;
+    return fsync(_fd) == 0;
+}
+
+bool TelemetryJournal::peek(Record& rec)
+{
+    while (_tail != _head) {
+        if (readRecord(_tail, rec)) {
+            return true;
+        }
+        // Skip torn or corrupted record
+        _stats.corrupted++;
+        _tail++;
+    }
+    return false;
+}
+
+void TelemetryJournal::pop()
+{
+    if (_tail != _head) {
+        _tail++;
+        _stats.replayed++;
+    }
+}
+
+bool TelemetryJournal::commit()
+{
+    if (!_started || _tail == _committed) return true;
+
+    // Erase fully consumed segments
+    for (uint32_t seg = _committed / _perSegment; seg < _tail / _perSegment; seg++) {
+        removeSegment(seg);
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/" CURSOR_FILE, _dir);
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return false;
+    const uint32_t data[2] = { _tail, crc32(&_tail, sizeof(_tail)) };
+    const bool ok = (write(fd, data, sizeof(data)) == (ssize_t)sizeof(data));
+    close(fd);
+    if (ok) {
+        _stats.bytesWritten += sizeof(data);
+        _committed = _tail;
+    }
+    return ok;
+}
+
+void TelemetryJournal::clear()
+{
+    if (!_started) return;
+    closeAll();
+    for (uint32_t seg = _tail / _perSegment; seg <= _head / _perSegment; seg++) {
+        removeSegment(seg);
+    }
+    _tail = _head = _committed = (_head / _perSegment + 1) * _perSegment;
+    char path[64];
+    snprintf(path, sizeof(path), "%s/" CURSOR_FILE, _dir);
+    unlink(path);
+}
+
+void TelemetryJournal::segmentPath(char* buf, size_t len, uint32_t seg) const
+{
+    snprintf(buf, len, "%s/" SEGMENT_PREFIX "%lu", _dir, (unsigned long)seg);
+}
+
+void TelemetryJournal::closeAll()
+{
+    sync();
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    if (_rfd >= 0) {
+        close(_rfd);
+        _rfd = -1;
+    }
+}
+
+void TelemetryJournal::removeSegment(uint32_t seg)
+{
+    if (_fd >= 0 && _fdSegment == seg) {
+        close(_fd);
+        _fd = -1;
+        _unsynced = 0;
+    }
+    if (_rfd >= 0 && _rfdSegment == seg) {
+        close(_rfd);
+        _rfd = -1;
+    }
+    char path[64];
+    segmentPath(path, sizeof(path), seg);
+    unlink(path);
+}
+
+bool TelemetryJournal::loadCursor(uint32_t& cursor)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/" CURSOR_FILE, _dir);
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    uint32_t data[2];
+    const bool ok = (read(fd, data, sizeof(data)) == (ssize_t)sizeof(data)) &&
+                    (data[1] == crc32(&data[0], sizeof(data[0])));
+    close(fd);
+    if (ok) {
+        cursor = data[0];
+    }
+    return ok;
+}
+
+bool TelemetryJournal::readRecord(uint32_t seq, Record& rec)
+{
+    const uint32_t seg = seq / _perSegment;
+    // Unsynced data is not visible to other file handles on LittleFS
+    if (_fd >= 0 && _fdSegment == seg) {
+        sync();
+    }
+    if (_rfd < 0 || _rfdSegment != seg) {
+        if (_rfd >= 0) {
+            close(_rfd);
+        }
+        char path[64];
+        segmentPath(path, sizeof(path), seg);
+        _rfd = open(path, O_RDONLY);
+        if (_rfd < 0) return false;
+        _rfdSegment = seg;
+    }
+    const off_t offset = (off_t)(seq % _perSegment) * RECORD_SIZE;
+    const bool ok = (lseek(_rfd, offset, SEEK_SET) == offset) &&
+                    (read(_rfd, &rec, RECORD_SIZE) == (ssize_t)RECORD_SIZE);
+    return ok && rec.seq == seq &&
+           rec.crc == crc32(&rec, offsetof(Record, crc));
+}
+
+uint32_t TelemetryJournal::crc32(const void* data, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
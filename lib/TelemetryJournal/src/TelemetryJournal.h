@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2024 Blynk Technologies Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TelemetryJournal_h
+#define TelemetryJournal_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef JOURNAL_VALUE_SIZE
+#define JOURNAL_VALUE_SIZE  22
+#endif
+
+/*
+ * Append-only journal of fixed-size records, stored in segment files.
+ *
+ * Record N is stored in segment file N / perSegment, so segments are
+ * written and erased as a whole, in order. The read cursor is persisted
+ * separately. Torn writes are detected using the CRC and skipped.
+ *
+ * On a journaling file system (i.e. LittleFS) every sync rewrites
+ * the last block of the file, so appends are synced in batches of
+ * syncEvery records, or by an explicit sync(). Unsynced records
+ * are lost on power failure.
+ */
+class TelemetryJournal {
+
+public:
+
+    enum Flags {
+        FLAG_UTC = 0x01,    // Timestamp is UTC time (ms), uptime otherwise
+    };
+
+    struct Record {
+        uint64_t  ts;
+        uint32_t  seq;
+        uint8_t   pin;
+        uint8_t   flags;
+        char      value[JOURNAL_VALUE_SIZE];
+        uint32_t  crc;
+    };
+
+    struct Stats {
+        uint32_t  appended;
+        uint32_t  replayed;
+        uint32_t  dropped;      // Oldest segments erased when full
+        uint32_t  corrupted;
+        uint64_t  bytesWritten;
+        uint32_t  syncs;
+    };
+
+    TelemetryJournal();
+
+    bool begin(const char* dir, unsigned perSegment = 256, unsigned maxSegments = 32,
+               unsigned syncEvery = 16);
+    void end();
+
+    bool append(uint8_t pin, uint64_t ts, uint8_t flags, const char* value);
+
+    // Flush the appended records to flash
+    bool sync();
+
+    // Read the oldest record that was not popped yet
+    bool peek(Record& rec);
+    void pop();
+
+    // Persist the read cursor and erase consumed segments
+    bool commit();
+
+    void clear();
+
+    uint32_t size() const       { return _head - _tail; }
+    uint32_t nextSeq() const    { return _head; }
+    bool     isEmpty() const    { return _head == _tail; }
+    const Stats& getStats() const { return _stats; }
+
+private:
+    void     segmentPath(char* buf, size_t len, uint32_t seg) const;
+    void     removeSegment(uint32_t seg);
+    void     closeAll();
+    bool     loadCursor(uint32_t& cursor);
+    bool     readRecord(uint32_t seq, Record& rec);
+
+    static uint32_t crc32(const void* data, size_t len);
+
+private:
+    char      _dir[48];
+    unsigned  _perSegment;
+    unsigned  _maxSegments;
+    unsigned  _syncEvery;
+    unsigned  _unsynced;    // Appended since the last sync
+    bool      _started;
+
+    uint32_t  _head;        // Next seq to write
+    uint32_t  _tail;        // Next seq to read
+    uint32_t  _committed;   // Persisted read cursor
+
+    int       _fd;          // Segment open for writing
+    uint32_t  _fdSegment;
+    int       _rfd;         // Segment open for reading
+    uint32_t  _rfdSegment;
+
+    Stats     _stats;
+};
+
+#endif /* TelemetryJournal_h */
@@ -0,0 +1,312 @@
+#include "unity.h"
+
+#include "TelemetryJournal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+
+/*
+ * Runs on the device flash with LittleFS (esp32dev), or on the host (native),
+ * where a local directory emulates the flash file system.
+ * On the device, flash programs and erases are counted by wrapping
+ * the partition API (see build_flags), so the figures include
+ * the file system metadata and the erase granularity.
+ * Benchmark figures are reported with TEST_MESSAGE.
+ */
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_partition.h>
+
+#define DIR_PATH      "/littlefs/journal_test"
+#define BENCH_COUNT   1024
+
+static uint32_t flashWritten = 0;
+static uint32_t flashErased = 0;
+
+extern "C" {
+
+esp_err_t __real_esp_partition_write(const esp_partition_t* part, size_t offset,
+                                     const void* src, size_t size);
+esp_err_t __real_esp_partition_erase_range(const esp_partition_t* part, size_t offset,
+                                           size_t size);
+
+esp_err_t __wrap_esp_partition_write(const esp_partition_t* part, size_t offset,
+                                     const void* src, size_t size) {
+  flashWritten += size;
+  return __real_esp_partition_write(part, offset, src, size);
+}
+
+esp_err_t __wrap_esp_partition_erase_range(const esp_partition_t* part, size_t offset,
+                                           size_t size) {
+  flashErased += size;
+  return __real_esp_partition_erase_range(part, offset, size);
+}
+
+}
+
+static uint64_t nowUs() {
+  return micros();
+}
+
+#else
+
+#include <time.h>
+
+#define DIR_PATH      "journal_test"
+#define BENCH_COUNT   4096
+
+static uint64_t nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
+
+static void wipe() {
+  DIR* d = opendir(DIR_PATH);
+  if (!d) return;
+  char path[64];
+  while (struct dirent* ent = readdir(d)) {
+    snprintf(path, sizeof(path), DIR_PATH "/%s", ent->d_name);
+    unlink(path);
+  }
+  closedir(d);
+  rmdir(DIR_PATH);
+}
+
+void setUp() {
+  wipe();
+}
+
+void tearDown() {
+  wipe();
+}
+
+void test_append_replay() {
+  TelemetryJournal j;
+  TEST_ASSERT_TRUE(j.begin(DIR_PATH, 8, 4));
+  for (int i = 0; i < 20; i++) {
+    char val[16];
+    snprintf(val, sizeof(val), "%d", i);
+    TEST_ASSERT_TRUE(j.append(5, 1000 + i, TelemetryJournal::FLAG_UTC, val));
+  }
+  TEST_ASSERT_EQUAL_UINT32(20, j.size());
+
+  TelemetryJournal::Record rec;
+  for (int i = 0; i < 20; i++) {
+    TEST_ASSERT_TRUE(j.peek(rec));
+    TEST_ASSERT_EQUAL_UINT64(1000 + i, rec.ts);
+    TEST_ASSERT_EQUAL_INT(5, rec.pin);
+    TEST_ASSERT_EQUAL_INT(i, atoi(rec.value));
+    j.pop();
+  }
+  TEST_ASSERT_FALSE(j.peek(rec));
+  TEST_ASSERT_TRUE(j.commit());
+}
+
+void test_cursor_survives_reset() {
+  TelemetryJournal j;
+  j.begin(DIR_PATH, 8, 4);
+  for (int i = 0; i < 10; i++) {
+    j.append(1, i, 0, "x");
+  }
+  TelemetryJournal::Record rec;
+  for (int i = 0; i < 3; i++) {
+    j.peek(rec);
+    j.pop();
+  }
+  j.commit();
+  j.peek(rec);  // Not committed
+  j.pop();
+  j.end();
+
+  TelemetryJournal j2;
+  j2.begin(DIR_PATH, 8, 4);
+  TEST_ASSERT_EQUAL_UINT32(7, j2.size());
+  TEST_ASSERT_TRUE(j2.peek(rec));
+  TEST_ASSERT_EQUAL_UINT64(3, rec.ts);
+
+  // Append continues after existing records
+  j2.append(1, 100, 0, "y");
+  TEST_ASSERT_EQUAL_UINT32(8, j2.size());
+}
+
+void test_unsynced_records_are_readable() {
+  TelemetryJournal j;
+  j.begin(DIR_PATH, 8, 4, 16);
+  j.append(1, 1, 0, "x");
+  j.append(1, 2, 0, "y");
+  TEST_ASSERT_EQUAL_UINT32(0, j.getStats().syncs);
+
+  TelemetryJournal::Record rec;
+  TEST_ASSERT_TRUE(j.peek(rec));
+  TEST_ASSERT_EQUAL_UINT64(1, rec.ts);
+  TEST_ASSERT_EQUAL_UINT32(1, j.getStats().syncs);
+}
+
+void test_torn_write() {
+  TelemetryJournal j;
+  j.begin(DIR_PATH, 8, 4);
+  for (int i = 0; i < 3; i++) {
+    j.append(1, i, 0, "x");
+  }
+  j.end();
+
+  // Power loss during the write of the 4th record
+  FILE* f = fopen(DIR_PATH "/seg0", "ab");
+  fwrite("garbage", 1, 7, f);
+  fclose(f);
+
+  TelemetryJournal j2;
+  j2.begin(DIR_PATH, 8, 4);
+  TEST_ASSERT_EQUAL_UINT32(3, j2.size());
+  j2.append(1, 3, 0, "x");
+
+  TelemetryJournal::Record rec;
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(j2.peek(rec));
+    TEST_ASSERT_EQUAL_UINT64(i, rec.ts);
+    j2.pop();
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, j2.getStats().corrupted);
+}
+
+void test_corrupted_record() {
+  TelemetryJournal j;
+  j.begin(DIR_PATH, 8, 4);
+  for (int i = 0; i < 3; i++) {
+    j.append(1, i, 0, "x");
+  }
+  j.end();
+
+  // Flip a byte in the 2nd record
+  FILE* f = fopen(DIR_PATH "/seg0", "r+b");
+  fseek(f, sizeof(TelemetryJournal::Record) + 1, SEEK_SET);
+  fputc(0x55, f);
+  fclose(f);
+
+  TelemetryJournal j2;
+  j2.begin(DIR_PATH, 8, 4);
+  TelemetryJournal::Record rec;
+  TEST_ASSERT_TRUE(j2.peek(rec));   j2.pop();
+  TEST_ASSERT_EQUAL_UINT64(0, rec.ts);
+  TEST_ASSERT_TRUE(j2.peek(rec));   j2.pop();
+  TEST_ASSERT_EQUAL_UINT64(2, rec.ts);
+  TEST_ASSERT_EQUAL_UINT32(1, j2.getStats().corrupted);
+}
+
+void test_rotation_drops_oldest() {
+  TelemetryJournal j;
+  j.begin(DIR_PATH, 8, 4);
+  for (int i = 0; i < 40; i++) {
+    j.append(1, i, 0, "x");
+  }
+  // 4 segments max: the newest one is being filled
+  TEST_ASSERT_EQUAL_UINT32(32, j.size());
+  TEST_ASSERT_EQUAL_UINT32(8, j.getStats().dropped);
+
+  TelemetryJournal::Record rec;
+  TEST_ASSERT_TRUE(j.peek(rec));
+  TEST_ASSERT_EQUAL_UINT64(8, rec.ts);
+}
+
+void test_benchmark() {
+  TelemetryJournal j;
+  j.begin(DIR_PATH, 256, 32);
+
+  const uint64_t t0 = nowUs();
+  for (int i = 0; i < BENCH_COUNT; i++) {
+    j.append(i % 32, i, TelemetryJournal::FLAG_UTC, "12345.678");
+  }
+  j.sync();
+  const uint64_t t1 = nowUs();
+
+  TelemetryJournal::Record rec;
+  int n = 0;
+  while (j.peek(rec)) {
+    j.pop();
+    if (++n % 16 == 0) {
+      j.commit();   // One cursor write per replay batch
+    }
+  }
+  j.commit();
+  const uint64_t t2 = nowUs();
+  TEST_ASSERT_EQUAL_INT(BENCH_COUNT, n);
+
+  // Payload: pin, timestamp and value
+  const double payload = BENCH_COUNT * (1 + 8 + strlen("12345.678"));
+  char msg[160];
+  snprintf(msg, sizeof(msg), "append: %.0f rec/s, replay: %.0f rec/s, write amplification: %.2f",
+           BENCH_COUNT * 1e6 / (t1 - t0), BENCH_COUNT * 1e6 / (t2 - t1),
+           j.getStats().bytesWritten / payload);
+  TEST_MESSAGE(msg);
+}
+
+#if defined(ARDUINO)
+
+// Flash bytes programmed per appended record
+static uint32_t flashPerRecord(unsigned syncEvery) {
+  TelemetryJournal j;
+  j.begin(DIR_PATH, 256, 32, syncEvery);
+  flashWritten = flashErased = 0;
+  for (int i = 0; i < BENCH_COUNT; i++) {
+    j.append(i % 32, i, TelemetryJournal::FLAG_UTC, "12345.678");
+  }
+  j.end();
+  char msg[96];
+  snprintf(msg, sizeof(msg), "sync every %u: %lu bytes programmed, %lu erased per record",
+           syncEvery, (unsigned long)(flashWritten / BENCH_COUNT),
+           (unsigned long)(flashErased / BENCH_COUNT));
+  TEST_MESSAGE(msg);
+  wipe();
+  return flashWritten / BENCH_COUNT;
+}
+
+void test_batched_sync_writes_less() {
+  const uint32_t single = flashPerRecord(1);
+  const uint32_t batched = flashPerRecord(16);
+  TEST_ASSERT_LESS_THAN_UINT32(single / 2, batched);
+}
+
+#endif
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_append_replay);
+  RUN_TEST(test_cursor_survives_reset);
+  RUN_TEST(test_unsynced_records_are_readable);
+  RUN_TEST(test_torn_write);
+  RUN_TEST(test_corrupted_record);
+  RUN_TEST(test_rotation_drops_oldest);
+  RUN_TEST(test_benchmark);
+#if defined(ARDUINO)
+  RUN_TEST(test_batched_sync_writes_less);
+#endif
+  return UNITY_END();
+}
+
+#if defined(ARDUINO)
+
+void setup() {
+  delay(1000);
+
+  LittleFS.begin(true);
+  runUnityTests();
+}
+
+void loop() {
+}
+
+#else
+
+int main() {
+  return runUnityTests();
+}
+
+#endif
@@ -47,7 +47,8 @@ void myTimer()
 {
   // This function describes what will happen with each timer tick
   // e.g. writing sensor value to datastream V5
-  Blynk.virtualWrite(V5, millis());  
+  // (values are queued if the device is temporarily offline)
+  BlynkEdgent.virtualWrite(V5, millis());
 }
 
 void setup()
@@ -59,6 +60,24 @@ void setup()
   // Set unlimited configuration mode retries (use only for testing!!!)
   BlynkEdgent.setConfigSkipLimit(0);
 
+  // Keep the device online while it is being re-configured over BLE (optional)
+  //BlynkEdgent.setConcurrentConfig(true);
+
+  // Connect Particle Cloud only once a day, or using "particle connect" command (optional)
+  //BlynkEdgent.setParticleCloud(Edgent::PARTICLE_CLOUD_ON_DEMAND, 24*3600);
+
+  // Send V5 only when it changes by 1%, but at least every 15 minutes (optional)
+  //BlynkEdgent.setPinFilterPercent(V5, 1.0, 0, 15*60*1000L);
+
+  // Sample A0 at 10 Hz, send only the mean and max every minute (optional)
+  //int ch = BlynkEdgent.addSampler([]() { return float(analogRead(A0)); }, 100, 60000L);
+  //BlynkEdgent.setSamplerOutput(ch, Sampler::AGG_MEAN, V6);
+  //BlynkEdgent.setSamplerOutput(ch, Sampler::AGG_MAX,  V7);
+
+  // Limit cellular data to 1 MB a day and 20 MB a month: uploads are stretched,
+  // metadata and the remote terminal are turned off as the budget is approached (optional)
+  //BlynkEdgent.setDataBudget(1000000, 20000000);
+
   // Setting interval to send data to Blynk Cloud to 1000ms. 
   // It means that data will be sent every ten seconds
   timer.setInterval(10000L, myTimer); 
@@ -69,7 +88,7 @@ void setup()
   // Enable remote and local Edgent Console (optional)
   VirtualSerial.autoAppendLF();
   MultiSerial.addStream(BLYNK_PRINT);
-  MultiSerial.addStream(VirtualSerial);
+  MultiSerial.addStream(BlynkEdgent.meterTerminal(VirtualSerial));
   BlynkEdgent.initConsole(MultiSerial);
 }
 
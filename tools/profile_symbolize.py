@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Blynk Technologies Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Symbolizes the output of the "prof dump" console command.
+#
+#   prof start 1000
+#   ... let it run ...
+#   prof dump              (save the output to profile.txt)
+#
+#   tools/profile_symbolize.py profile.txt --elf target/<platform>/firmware.elf
+#
+# Addresses outside of the application (i.e. in Device OS system parts)
+# can be resolved by passing the system part ELF files with more --elf options.
+
+import argparse
+import bisect
+import collections
+import re
+import subprocess
+import sys
+
+LINE_RE = re.compile(r"^(pc|lr)\s+0x([0-9a-fA-F]+)\s+(\d+)\s*$")
+
+
+def parse_dump(path):
+    hist = {"pc": collections.Counter(), "lr": collections.Counter()}
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            m = LINE_RE.match(line.strip())
+            if m:
+                hist[m.group(1)][int(m.group(2), 16)] += int(m.group(3))
+    return hist
+
+
+class Symbols:
+    def __init__(self, tool_prefix):
+        self.prefix = tool_prefix
+        self.addrs = []
+        self.syms = []
+
+    def load(self, elf):
+        out = subprocess.run(
+            [self.prefix + "nm", "-n", "-C", "-S", "--defined-only", elf],
+            check=True, capture_output=True, text=True).stdout
+        for line in out.splitlines():
+            parts = line.split(None, 3)
+            if len(parts) != 4 or parts[2] not in "tTwW":
+                continue
+            addr = int(parts[0], 16) & ~1
+            size = int(parts[1], 16)
+            self.syms.append((addr, addr + size, parts[3]))
+        self.syms.sort()
+        self.addrs = [s[0] for s in self.syms]
+
+    def lookup(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i >= 0:
+            start, end, name = self.syms[i]
+            if start <= addr < end:
+                return name
+        return "0x%08x" % addr
+
+
+def report(title, counter, syms, top):
+    total = sum(counter.values())
+    if not total:
+        return
+    funcs = collections.Counter()
+    for addr, count in counter.items():
+        funcs[syms.lookup(addr)] += count
+    print("%s (%d samples)" % (title, total))
+    for name, count in funcs.most_common(top):
+        print("  %6.2f%%  %7d  %s" % (100.0 * count / total, count, name))
+    print()
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Symbolize 'prof dump' output")
+    ap.add_argument("dump", help="file with the 'prof dump' output")
+    ap.add_argument("--elf", action="append", required=True, help="firmware ELF file (repeatable)")
+    ap.add_argument("--prefix", default="arm-none-eabi-", help="toolchain prefix")
+    ap.add_argument("--top", type=int, default=30, help="number of functions to show")
+    args = ap.parse_args()
+
+    hist = parse_dump(args.dump)
+    if not hist["pc"]:
+        sys.exit("No samples found in %s" % args.dump)
+
+    syms = Symbols(args.prefix)
+    for elf in args.elf:
+        syms.load(elf)
+
+    report("Functions (PC)", hist["pc"], syms, args.top)
+    report("Callers (LR)", hist["lr"], syms, args.top)
+
+
+if __name__ == "__main__":
+    main()